@@ -8,117 +8,1458 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
 #include <cmath>
 #include <complex>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
 
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
 namespace FFT
 {
 
 // MACROS
-#define PI 3.1415926536
+#define PI 3.14159265358979323846
 
 // TYPEDEF's
 typedef std::complex<double> Complex; // Complex number representation
 
-// Function to reverse bits (same as provided previously)
-unsigned int bitReverse(unsigned int x, int log2n)
+// Smallest number >= n whose only prime factors are 2, 3 and 5
+int nextSmoothSize(int n)
 {
-  int n = 0;
-  int mask = 0x1;
-  for (int i = 0; i < log2n; i++)
+  for (int m = std::max(n, 1);; ++m)
   {
-    n <<= 1;
-    n |= (x & 1);
-    x >>= 1;
+    int r = m;
+    for (int p : {2, 3, 5})
+    {
+      while (r % p == 0)
+      {
+        r /= p;
+      }
+    }
+    if (r == 1)
+    {
+      return m;
+    }
   }
-  return n;
 }
 
-// Function to perform 1D FFT
-void fft(std::vector<Complex>& data, bool inverse)
+// Splits n into radix-4/2/3/5 stages, radix-4 first as it needs the fewest
+// multiplications. Returns false if n has any other prime factor.
+bool factorize(int n, std::vector<int>& radices)
+{
+  radices.clear();
+  int rest = n;
+  while (rest % 4 == 0)
+  {
+    radices.push_back(4);
+    rest /= 4;
+  }
+  for (int p : {2, 3, 5})
+  {
+    while (rest % p == 0)
+    {
+      radices.push_back(p);
+      rest /= p;
+    }
+  }
+  return rest == 1;
+}
+
+// FFT plan: everything that depends only on the transform size and direction
+// (factorization, twiddle factors, scratch space) is computed once in the
+// constructor, so the same plan can be executed on many rows/columns.
+//
+// Sizes of the form 2^a * 3^b * 5^c run as a self-sorting (Stockham) mixed
+// radix-2/3/4/5 FFT. Any other size is computed with Bluestein's algorithm,
+// i.e. as a circular convolution of a smooth size >= 2n - 1.
+class Plan
+{
+public:
+  Plan(int n, bool inverse) : n_(n), inverse_(inverse)
+  {
+    assert(n > 0);
+    const double sign = inverse ? 1.0 : -1.0;
+
+    std::vector<int> radices;
+    if (!factorize(n, radices))
+    {
+      initBluestein(sign);
+      return;
+    }
+
+    // Each twiddle is evaluated directly instead of by repeated multiplication,
+    // so there is no accumulated rounding error for large n.
+    int l = 1;
+    for (int p : radices)
+    {
+      Stage stage;
+      stage.radix = p;
+      stage.l = l;
+      stage.m = n / (l * p);
+      stage.twiddleOffset = twiddles_.size();
+      for (int f = 0; f < l; ++f)
+      {
+        for (int r = 1; r < p; ++r)
+        {
+          twiddles_.push_back(std::polar(1.0, sign * 2.0 * PI * f * r / (l * p)));
+        }
+      }
+      stages_.push_back(stage);
+      l *= p;
+    }
+    scratch_.resize(scratchSize());
+  }
+
+  int size() const { return n_; }
+  bool inverse() const { return inverse_; }
+
+  // Number of Complex elements needed by the scratch-taking execute()
+  std::size_t scratchSize() const
+  {
+    if (bluesteinForward_)
+    {
+      return chirpSpectrum_.size() + bluesteinForward_->scratchSize();
+    }
+    return 2 * static_cast<std::size_t>(n_);
+  }
+
+  // In-place transform of n contiguous samples
+  void execute(Complex* data)
+  {
+    execute(data, 1, scratch_.data());
+  }
+
+  void execute(std::vector<Complex>& data)
+  {
+    assert(static_cast<int>(data.size()) == n_);
+    execute(data.data(), 1, scratch_.data());
+  }
+
+  // In-place transform of n samples spaced `stride` elements apart
+  // (e.g. a column of a row-major matrix).
+  void execute(Complex* data, std::ptrdiff_t stride)
+  {
+    execute(data, stride, scratch_.data());
+  }
+
+  // Same as above, with caller-provided scratch of scratchSize() elements.
+  // The plan itself is not modified, so one plan can be shared by callers
+  // that each bring their own scratch.
+  void execute(Complex* data, std::ptrdiff_t stride, Complex* scratch) const
+  {
+    if (bluesteinForward_)
+    {
+      bluestein(data, stride, scratch);
+    }
+    else
+    {
+      stockham(data, stride, scratch);
+    }
+  }
+
+private:
+  struct Stage
+  {
+    int radix;                 // butterfly size
+    int l;                     // length of the sub-transforms already combined
+    int m;                     // number of interleaved sub-transforms left
+    std::size_t twiddleOffset; // first twiddle of this stage in twiddles_
+  };
+
+  void initBluestein(double sign)
+  {
+    // chirp[k] = exp(sign * i * pi * k^2 / n); k^2 is reduced mod 2n to keep the angle small
+    chirp_.resize(n_);
+    for (long long k = 0; k < n_; ++k)
+    {
+      chirp_[k] = std::polar(1.0, sign * PI * static_cast<double>((k * k) % (2LL * n_)) / n_);
+    }
+
+    const int m = nextSmoothSize(2 * n_ - 1);
+    auto forward = std::make_shared<Plan>(m, false);
+    bluesteinInverse_ = std::make_shared<Plan>(m, true);
+
+    // Spectrum of the (circularly wrapped) conjugate chirp
+    chirpSpectrum_.assign(m, Complex(0, 0));
+    chirpSpectrum_[0] = std::conj(chirp_[0]);
+    for (int k = 1; k < n_; ++k)
+    {
+      chirpSpectrum_[k] = chirpSpectrum_[m - k] = std::conj(chirp_[k]);
+    }
+    forward->execute(chirpSpectrum_);
+    bluesteinForward_ = forward;
+    scratch_.resize(scratchSize());
+  }
+
+  // Radix-p butterflies of one Stockham stage: in -> out
+  void runStage(const Stage& s, const Complex* in, Complex* out) const
+  {
+    const Complex* tw = twiddles_.data() + s.twiddleOffset;
+    const int p = s.radix;
+    const int l = s.l;
+    const int m = s.m;
+    const double sign = inverse_ ? 1.0 : -1.0;
+
+    for (int f = 0; f < l; ++f)
+    {
+      const Complex* w = tw + f * (p - 1);
+      const Complex* x = in + f * p * m;
+      Complex* y = out + f * m;
+      const std::ptrdiff_t lm = static_cast<std::ptrdiff_t>(l) * m;
+
+      switch (p)
+      {
+        case 2:
+          for (int k = 0; k < m; ++k)
+          {
+            const Complex a0 = x[k];
+            const Complex a1 = w[0] * x[m + k];
+            y[k] = a0 + a1;
+            y[lm + k] = a0 - a1;
+          }
+          break;
+        case 3:
+        {
+          const double s3 = sign * 0.86602540378443864676; // sin(2*pi/3)
+          for (int k = 0; k < m; ++k)
+          {
+            const Complex a0 = x[k];
+            const Complex a1 = w[0] * x[m + k];
+            const Complex a2 = w[1] * x[2 * m + k];
+            const Complex t1 = a1 + a2;
+            const Complex t2 = a0 - 0.5 * t1;
+            const Complex t3 = s3 * (a1 - a2);
+            const Complex it3(-t3.imag(), t3.real());
+            y[k] = a0 + t1;
+            y[lm + k] = t2 + it3;
+            y[2 * lm + k] = t2 - it3;
+          }
+          break;
+        }
+        case 4:
+          for (int k = 0; k < m; ++k)
+          {
+            const Complex a0 = x[k];
+            const Complex a1 = w[0] * x[m + k];
+            const Complex a2 = w[1] * x[2 * m + k];
+            const Complex a3 = w[2] * x[3 * m + k];
+            const Complex t0 = a0 + a2;
+            const Complex t1 = a0 - a2;
+            const Complex t2 = a1 + a3;
+            const Complex d = a1 - a3;
+            // (a1 - a3) multiplied by exp(sign * i * pi / 2)
+            const Complex t3 = inverse_ ? Complex(-d.imag(), d.real()) : Complex(d.imag(), -d.real());
+            y[k] = t0 + t2;
+            y[lm + k] = t1 + t3;
+            y[2 * lm + k] = t0 - t2;
+            y[3 * lm + k] = t1 - t3;
+          }
+          break;
+        case 5:
+        {
+          const double c1 = 0.30901699437494742410;         // cos(2*pi/5)
+          const double c2 = -0.80901699437494742410;        // cos(4*pi/5)
+          const double s1 = sign * 0.95105651629515357212; // sin(2*pi/5)
+          const double s2 = sign * 0.58778525229247312917; // sin(4*pi/5)
+          for (int k = 0; k < m; ++k)
+          {
+            const Complex a0 = x[k];
+            const Complex a1 = w[0] * x[m + k];
+            const Complex a2 = w[1] * x[2 * m + k];
+            const Complex a3 = w[2] * x[3 * m + k];
+            const Complex a4 = w[3] * x[4 * m + k];
+            const Complex b1 = a1 + a4;
+            const Complex b2 = a2 + a3;
+            const Complex d1 = a1 - a4;
+            const Complex d2 = a2 - a3;
+            const Complex r1 = a0 + c1 * b1 + c2 * b2;
+            const Complex r2 = a0 + c2 * b1 + c1 * b2;
+            const Complex q1 = s1 * d1 + s2 * d2;
+            const Complex q2 = s2 * d1 - s1 * d2;
+            const Complex iq1(-q1.imag(), q1.real());
+            const Complex iq2(-q2.imag(), q2.real());
+            y[k] = a0 + b1 + b2;
+            y[lm + k] = r1 + iq1;
+            y[2 * lm + k] = r2 + iq2;
+            y[3 * lm + k] = r2 - iq2;
+            y[4 * lm + k] = r1 - iq1;
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  // Stages ping-pong between two buffers; the last one is copied (and
+  // scaled, for the inverse transform) back into data.
+  void stockham(Complex* data, std::ptrdiff_t stride, Complex* scratch) const
+  {
+    Complex* a = scratch;
+    Complex* b = scratch + n_;
+    if (stride != 1)
+    {
+      for (int i = 0; i < n_; ++i)
+      {
+        a[i] = data[i * stride];
+      }
+    }
+    else
+    {
+      std::copy(data, data + n_, a);
+    }
+
+    for (const Stage& s : stages_)
+    {
+      runStage(s, a, b);
+      std::swap(a, b);
+    }
+
+    const double scale = inverse_ ? 1.0 / n_ : 1.0;
+    for (int i = 0; i < n_; ++i)
+    {
+      data[i * stride] = a[i] * scale;
+    }
+  }
+
+  // With jk = (j^2 + k^2 - (k - j)^2) / 2 the DFT becomes
+  // X[k] = chirp[k] * sum_j (x[j] * chirp[j]) * conj(chirp[k - j]),
+  // a circular convolution evaluated with two smooth-size FFTs.
+  void bluestein(Complex* data, std::ptrdiff_t stride, Complex* scratch) const
+  {
+    const int m = static_cast<int>(chirpSpectrum_.size());
+    Complex* conv = scratch;
+    Complex* subScratch = scratch + m;
+
+    for (int k = 0; k < n_; ++k)
+    {
+      conv[k] = data[k * stride] * chirp_[k];
+    }
+    std::fill(conv + n_, conv + m, Complex(0, 0));
+
+    bluesteinForward_->execute(conv, 1, subScratch);
+    for (int k = 0; k < m; ++k)
+    {
+      conv[k] *= chirpSpectrum_[k];
+    }
+    bluesteinInverse_->execute(conv, 1, subScratch);
+
+    const double scale = inverse_ ? 1.0 / n_ : 1.0;
+    for (int k = 0; k < n_; ++k)
+    {
+      data[k * stride] = conv[k] * chirp_[k] * scale;
+    }
+  }
+
+  int n_;
+  bool inverse_;
+  std::vector<Stage> stages_;
+  std::vector<Complex> twiddles_;
+  // Bluestein state, only used for sizes with prime factors other than 2, 3, 5
+  std::vector<Complex> chirp_;
+  std::vector<Complex> chirpSpectrum_;
+  std::shared_ptr<const Plan> bluesteinForward_;
+  std::shared_ptr<const Plan> bluesteinInverse_;
+  std::vector<Complex> scratch_;
+};
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi" // vector arguments only cross always_inline boundaries
+#endif
+
+// One Stockham stage in split format (separate real and imaginary arrays),
+// same indexing as Plan::runStage
+template <typename T>
+struct SplitStage
+{
+  int radix;
+  int l;
+  int m;
+  const T* twRe; // (radix - 1) twiddles per f
+  const T* twIm;
+};
+
+// Split-format butterflies. Each kernel processes k in [k, kEnd) in steps of
+// lanes<V, T>() and returns the first k it did not process, so a vector pass
+// is followed by the same kernel with V == T for the remainder.
+template <typename V, typename T>
+SIMD_INLINE int splitRadix2(const T* xr, const T* xi, T* yr, T* yi, std::ptrdiff_t m, std::ptrdiff_t lm, const T* wr,
+                            const T* wi, int k, int kEnd)
+{
+  constexpr int W = simd::lanes<V, T>();
+  for (; k + W <= kEnd; k += W)
+  {
+    const V a0r = simd::load<V>(xr + k), a0i = simd::load<V>(xi + k);
+    const V x1r = simd::load<V>(xr + m + k), x1i = simd::load<V>(xi + m + k);
+    const V a1r = x1r * wr[0] - x1i * wi[0], a1i = x1r * wi[0] + x1i * wr[0];
+    simd::store(yr + k, a0r + a1r);
+    simd::store(yi + k, a0i + a1i);
+    simd::store(yr + lm + k, a0r - a1r);
+    simd::store(yi + lm + k, a0i - a1i);
+  }
+  return k;
+}
+
+template <typename V, typename T>
+SIMD_INLINE int splitRadix3(const T* xr, const T* xi, T* yr, T* yi, std::ptrdiff_t m, std::ptrdiff_t lm, const T* wr,
+                            const T* wi, T s3, int k, int kEnd)
+{
+  constexpr int W = simd::lanes<V, T>();
+  for (; k + W <= kEnd; k += W)
+  {
+    const V a0r = simd::load<V>(xr + k), a0i = simd::load<V>(xi + k);
+    const V x1r = simd::load<V>(xr + m + k), x1i = simd::load<V>(xi + m + k);
+    const V x2r = simd::load<V>(xr + 2 * m + k), x2i = simd::load<V>(xi + 2 * m + k);
+    const V a1r = x1r * wr[0] - x1i * wi[0], a1i = x1r * wi[0] + x1i * wr[0];
+    const V a2r = x2r * wr[1] - x2i * wi[1], a2i = x2r * wi[1] + x2i * wr[1];
+    const V t1r = a1r + a2r, t1i = a1i + a2i;
+    const V t2r = a0r - t1r * T(0.5), t2i = a0i - t1i * T(0.5);
+    const V t3r = (a1r - a2r) * s3, t3i = (a1i - a2i) * s3;
+    simd::store(yr + k, a0r + t1r);
+    simd::store(yi + k, a0i + t1i);
+    simd::store(yr + lm + k, t2r - t3i);
+    simd::store(yi + lm + k, t2i + t3r);
+    simd::store(yr + 2 * lm + k, t2r + t3i);
+    simd::store(yi + 2 * lm + k, t2i - t3r);
+  }
+  return k;
+}
+
+// y1/y3 are passed swapped for the inverse transform, which turns the
+// multiplication of (a1 - a3) by -i into one by +i
+template <typename V, typename T>
+SIMD_INLINE int splitRadix4(const T* xr, const T* xi, T* y0r, T* y0i, T* y1r, T* y1i, T* y2r, T* y2i, T* y3r, T* y3i,
+                            std::ptrdiff_t m, const T* wr, const T* wi, int k, int kEnd)
+{
+  constexpr int W = simd::lanes<V, T>();
+  for (; k + W <= kEnd; k += W)
+  {
+    const V a0r = simd::load<V>(xr + k), a0i = simd::load<V>(xi + k);
+    const V x1r = simd::load<V>(xr + m + k), x1i = simd::load<V>(xi + m + k);
+    const V x2r = simd::load<V>(xr + 2 * m + k), x2i = simd::load<V>(xi + 2 * m + k);
+    const V x3r = simd::load<V>(xr + 3 * m + k), x3i = simd::load<V>(xi + 3 * m + k);
+    const V a1r = x1r * wr[0] - x1i * wi[0], a1i = x1r * wi[0] + x1i * wr[0];
+    const V a2r = x2r * wr[1] - x2i * wi[1], a2i = x2r * wi[1] + x2i * wr[1];
+    const V a3r = x3r * wr[2] - x3i * wi[2], a3i = x3r * wi[2] + x3i * wr[2];
+    const V t0r = a0r + a2r, t0i = a0i + a2i;
+    const V t1r = a0r - a2r, t1i = a0i - a2i;
+    const V t2r = a1r + a3r, t2i = a1i + a3i;
+    const V dr = a1r - a3r, di = a1i - a3i;
+    simd::store(y0r + k, t0r + t2r);
+    simd::store(y0i + k, t0i + t2i);
+    simd::store(y2r + k, t0r - t2r);
+    simd::store(y2i + k, t0i - t2i);
+    simd::store(y1r + k, t1r + di);
+    simd::store(y1i + k, t1i - dr);
+    simd::store(y3r + k, t1r - di);
+    simd::store(y3i + k, t1i + dr);
+  }
+  return k;
+}
+
+template <typename V, typename T>
+SIMD_INLINE int splitRadix5(const T* xr, const T* xi, T* yr, T* yi, std::ptrdiff_t m, std::ptrdiff_t lm, const T* wr,
+                            const T* wi, T s1, T s2, int k, int kEnd)
+{
+  constexpr int W = simd::lanes<V, T>();
+  const T c1 = T(0.30901699437494742410);  // cos(2*pi/5)
+  const T c2 = T(-0.80901699437494742410); // cos(4*pi/5)
+  for (; k + W <= kEnd; k += W)
+  {
+    const V a0r = simd::load<V>(xr + k), a0i = simd::load<V>(xi + k);
+    V ar[4], ai[4];
+    for (int r = 0; r < 4; ++r)
+    {
+      const V xR = simd::load<V>(xr + (r + 1) * m + k), xI = simd::load<V>(xi + (r + 1) * m + k);
+      ar[r] = xR * wr[r] - xI * wi[r];
+      ai[r] = xR * wi[r] + xI * wr[r];
+    }
+    const V b1r = ar[0] + ar[3], b1i = ai[0] + ai[3];
+    const V b2r = ar[1] + ar[2], b2i = ai[1] + ai[2];
+    const V d1r = ar[0] - ar[3], d1i = ai[0] - ai[3];
+    const V d2r = ar[1] - ar[2], d2i = ai[1] - ai[2];
+    const V r1r = a0r + b1r * c1 + b2r * c2, r1i = a0i + b1i * c1 + b2i * c2;
+    const V r2r = a0r + b1r * c2 + b2r * c1, r2i = a0i + b1i * c2 + b2i * c1;
+    const V q1r = d1r * s1 + d2r * s2, q1i = d1i * s1 + d2i * s2;
+    const V q2r = d1r * s2 - d2r * s1, q2i = d1i * s2 - d2i * s1;
+    simd::store(yr + k, a0r + b1r + b2r);
+    simd::store(yi + k, a0i + b1i + b2i);
+    simd::store(yr + lm + k, r1r - q1i);
+    simd::store(yi + lm + k, r1i + q1r);
+    simd::store(yr + 2 * lm + k, r2r - q2i);
+    simd::store(yi + 2 * lm + k, r2i + q2r);
+    simd::store(yr + 3 * lm + k, r2r + q2i);
+    simd::store(yi + 3 * lm + k, r2i - q2r);
+    simd::store(yr + 4 * lm + k, r1r + q1i);
+    simd::store(yi + 4 * lm + k, r1i - q1r);
+  }
+  return k;
+}
+
+// Whole stage: vector kernels over k, then narrower V2 kernels and scalar
+// kernels for the tail. Late stages with m < lanes run on the tail kernels.
+template <typename V, typename V2, typename T>
+SIMD_INLINE void splitStage(const SplitStage<T>& s, bool inverse, const T* xr, const T* xi, T* yr, T* yi)
+{
+  const int p = s.radix;
+  const int m = s.m;
+  const std::ptrdiff_t lm = static_cast<std::ptrdiff_t>(s.l) * m;
+  const T sign = inverse ? T(1) : T(-1);
+
+  for (int f = 0; f < s.l; ++f)
+  {
+    const T* wr = s.twRe + f * (p - 1);
+    const T* wi = s.twIm + f * (p - 1);
+    const T* ar = xr + static_cast<std::ptrdiff_t>(f) * p * m;
+    const T* ai = xi + static_cast<std::ptrdiff_t>(f) * p * m;
+    T* br = yr + static_cast<std::ptrdiff_t>(f) * m;
+    T* bi = yi + static_cast<std::ptrdiff_t>(f) * m;
+    int k = 0;
+
+    switch (p)
+    {
+      case 2:
+        k = splitRadix2<V>(ar, ai, br, bi, m, lm, wr, wi, 0, m);
+        k = splitRadix2<V2>(ar, ai, br, bi, m, lm, wr, wi, k, m);
+        splitRadix2<T>(ar, ai, br, bi, m, lm, wr, wi, k, m);
+        break;
+      case 3:
+      {
+        const T s3 = sign * T(0.86602540378443864676); // sin(2*pi/3)
+        k = splitRadix3<V>(ar, ai, br, bi, m, lm, wr, wi, s3, 0, m);
+        k = splitRadix3<V2>(ar, ai, br, bi, m, lm, wr, wi, s3, k, m);
+        splitRadix3<T>(ar, ai, br, bi, m, lm, wr, wi, s3, k, m);
+        break;
+      }
+      case 4:
+      {
+        T* y1r = br + (inverse ? 3 : 1) * lm;
+        T* y1i = bi + (inverse ? 3 : 1) * lm;
+        T* y3r = br + (inverse ? 1 : 3) * lm;
+        T* y3i = bi + (inverse ? 1 : 3) * lm;
+        k = splitRadix4<V>(ar, ai, br, bi, y1r, y1i, br + 2 * lm, bi + 2 * lm, y3r, y3i, m, wr, wi, 0, m);
+        k = splitRadix4<V2>(ar, ai, br, bi, y1r, y1i, br + 2 * lm, bi + 2 * lm, y3r, y3i, m, wr, wi, k, m);
+        splitRadix4<T>(ar, ai, br, bi, y1r, y1i, br + 2 * lm, bi + 2 * lm, y3r, y3i, m, wr, wi, k, m);
+        break;
+      }
+      case 5:
+      {
+        const T s1 = sign * T(0.95105651629515357212); // sin(2*pi/5)
+        const T s2 = sign * T(0.58778525229247312917); // sin(4*pi/5)
+        k = splitRadix5<V>(ar, ai, br, bi, m, lm, wr, wi, s1, s2, 0, m);
+        k = splitRadix5<V2>(ar, ai, br, bi, m, lm, wr, wi, s1, s2, k, m);
+        splitRadix5<T>(ar, ai, br, bi, m, lm, wr, wi, s1, s2, k, m);
+        break;
+      }
+    }
+  }
+}
+
+// Per-instruction-set instantiations of splitStage
+template <typename T>
+void splitStageScalar(const SplitStage<T>& s, bool inverse, const T* xr, const T* xi, T* yr, T* yi)
+{
+  splitStage<T, T, T>(s, inverse, xr, xi, yr, yi);
+}
+
+#if defined(SIMD_X86)
+template <typename T>
+SIMD_TARGET("sse2") void splitStageSse2(const SplitStage<T>& s, bool inverse, const T* xr, const T* xi, T* yr, T* yi)
+{
+  splitStage<typename simd::Vector<T, 16>::type, T, T>(s, inverse, xr, xi, yr, yi);
+}
+
+template <typename T>
+SIMD_TARGET("avx2,fma") void splitStageAvx2(const SplitStage<T>& s, bool inverse, const T* xr, const T* xi, T* yr, T* yi)
+{
+  splitStage<typename simd::Vector<T, 32>::type, typename simd::Vector<T, 16>::type, T>(s, inverse, xr, xi, yr, yi);
+}
+#endif
+
+#if defined(SIMD_NEON)
+template <typename T>
+void splitStageNeon(const SplitStage<T>& s, bool inverse, const T* xr, const T* xi, T* yr, T* yi)
+{
+  splitStage<typename simd::Vector<T, 16>::type, T, T>(s, inverse, xr, xi, yr, yi);
+}
+#endif
+
+// Compile-time kernels for the sizes nearly every image comes in: 256 to
+// 2048, plus 128 for the half-size complex FFT behind the rows of 256-wide
+// real images. The stage list, every loop bound and the twiddle tables are
+// constants of the template, so there is no stage loop, no radix switch and
+// no runtime trip count. Wide stages use the split kernels above; the late
+// stages (m below kFixedWideStage), where those fall back to short scalar
+// tails per f, run as one flat loop with their twiddles stored per (f, k).
+const int kFixedSizes[] = {128, 256, 512, 1024, 2048};
+const int kFixedWideStage = 4;
+
+// Function to evaluate cos(x) at compile time (std::cos is not constexpr):
+// Taylor series after reducing x to [-pi, pi]
+constexpr double constexprCos(double x)
+{
+  const double twoPi = 2.0 * PI;
+  x -= twoPi * static_cast<long long>(x / twoPi);
+  x = x > PI ? x - twoPi : (x < -PI ? x + twoPi : x);
+  double term = 1.0;
+  double sum = 1.0;
+  for (int i = 1; i < 40; ++i)
+  {
+    term *= -x * x / ((2 * i - 1) * (2 * i));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double constexprSin(double x) { return constexprCos(x - PI / 2); }
+
+// Radix of the stage that starts at l, as factorize() picks it for a power of two
+constexpr int fixedRadix(int n, int l) { return (n / l) % 4 == 0 ? 4 : 2; }
+
+// Twiddles of one stage: (radix - 1) per f, or per (f, k) for a late stage
+constexpr int fixedStageTwiddles(int n, int l)
+{
+  const int p = fixedRadix(n, l);
+  const int m = n / (l * p);
+  return (p - 1) * l * (m < kFixedWideStage ? m : 1);
+}
+
+constexpr int fixedTwiddleCount(int n)
+{
+  int count = 0;
+  for (int l = 1; l < n; l *= fixedRadix(n, l))
+  {
+    count += fixedStageTwiddles(n, l);
+  }
+  return count;
+}
+
+constexpr int fixedStageCount(int n)
+{
+  int count = 0;
+  for (int l = 1; l < n; l *= fixedRadix(n, l))
+  {
+    ++count;
+  }
+  return count;
+}
+
+// Twiddle tables of a fixed size, stage after stage: (f, r) in the generic
+// layout for wide stages, [r - 1][f * m + k] for late stages
+template <typename T, int N, bool Inverse>
+struct FixedTwiddles
+{
+  std::array<T, fixedTwiddleCount(N)> re{};
+  std::array<T, fixedTwiddleCount(N)> im{};
+
+  constexpr FixedTwiddles()
+  {
+    const double sign = Inverse ? 1.0 : -1.0;
+    int i = 0;
+    for (int l = 1; l < N; l *= fixedRadix(N, l))
+    {
+      const int p = fixedRadix(N, l);
+      const int m = N / (l * p);
+      const bool late = m < kFixedWideStage;
+      for (int r = 1; r < p && late; ++r)
+      {
+        for (int f = 0; f < l; ++f)
+        {
+          for (int k = 0; k < m; ++k, ++i)
+          {
+            re[i] = static_cast<T>(constexprCos(sign * 2.0 * PI * f * r / (l * p)));
+            im[i] = static_cast<T>(constexprSin(sign * 2.0 * PI * f * r / (l * p)));
+          }
+        }
+      }
+      for (int f = 0; f < l && !late; ++f)
+      {
+        for (int r = 1; r < p; ++r, ++i)
+        {
+          re[i] = static_cast<T>(constexprCos(sign * 2.0 * PI * f * r / (l * p)));
+          im[i] = static_cast<T>(constexprSin(sign * 2.0 * PI * f * r / (l * p)));
+        }
+      }
+    }
+  }
+};
+
+template <typename T, int N, bool Inverse>
+inline constexpr FixedTwiddles<T, N, Inverse> kFixedTwiddles{};
+
+// Late stage (m < kFixedWideStage) as one flat loop over j = f * m + k:
+// every bound is a constant, and the outputs y[r * l * m + j] and the
+// twiddles are contiguous in j. Vector loads would need strided gathers
+// here, which cost more than they save.
+template <typename T, int P, int L, int M, bool Inverse>
+SIMD_INLINE void fixedLateStage(const T* xr, const T* xi, T* yr, T* yi, const T* wr, const T* wi)
+{
+  constexpr int LM = L * M;
+  for (int j = 0; j < LM; ++j)
+  {
+    const int x0 = (j / M) * P * M + j % M;
+    T ar[P], ai[P];
+    ar[0] = xr[x0];
+    ai[0] = xi[x0];
+    for (int q = 1; q < P; ++q)
+    {
+      const T xR = xr[x0 + q * M], xI = xi[x0 + q * M];
+      const T wR = wr[(q - 1) * LM + j], wI = wi[(q - 1) * LM + j];
+      ar[q] = xR * wR - xI * wI;
+      ai[q] = xR * wI + xI * wR;
+    }
+    if constexpr (P == 2)
+    {
+      yr[j] = ar[0] + ar[1];
+      yi[j] = ai[0] + ai[1];
+      yr[LM + j] = ar[0] - ar[1];
+      yi[LM + j] = ai[0] - ai[1];
+    }
+    else
+    {
+      // Same butterfly as splitRadix4
+      constexpr int y1 = Inverse ? 3 : 1;
+      constexpr int y3 = Inverse ? 1 : 3;
+      const T t0r = ar[0] + ar[2], t0i = ai[0] + ai[2];
+      const T t1r = ar[0] - ar[2], t1i = ai[0] - ai[2];
+      const T t2r = ar[1] + ar[3], t2i = ai[1] + ai[3];
+      const T dr = ar[1] - ar[3], di = ai[1] - ai[3];
+      yr[j] = t0r + t2r;
+      yi[j] = t0i + t2i;
+      yr[2 * LM + j] = t0r - t2r;
+      yi[2 * LM + j] = t0i - t2i;
+      yr[y1 * LM + j] = t1r + di;
+      yi[y1 * LM + j] = t1i - dr;
+      yr[y3 * LM + j] = t1r - di;
+      yi[y3 * LM + j] = t1i + dr;
+    }
+  }
+}
+
+// Stages from l on, ping-ponging between (ar, ai) and (br, bi)
+template <typename V, typename V2, typename T, int N, bool Inverse, int L, int Offset>
+SIMD_INLINE void fixedStages(T* ar, T* ai, T* br, T* bi)
+{
+  if constexpr (L < N)
+  {
+    constexpr int P = fixedRadix(N, L);
+    constexpr int M = N / (L * P);
+    constexpr std::ptrdiff_t LM = static_cast<std::ptrdiff_t>(L) * M;
+    const T* wr = kFixedTwiddles<T, N, Inverse>.re.data() + Offset;
+    const T* wi = kFixedTwiddles<T, N, Inverse>.im.data() + Offset;
+    if constexpr (M < kFixedWideStage)
+    {
+      fixedLateStage<T, P, L, M, Inverse>(ar, ai, br, bi, wr, wi);
+    }
+    else
+    {
+      for (int f = 0; f < L; ++f)
+      {
+        const T* xr = ar + static_cast<std::ptrdiff_t>(f) * P * M;
+        const T* xi = ai + static_cast<std::ptrdiff_t>(f) * P * M;
+        T* yr = br + static_cast<std::ptrdiff_t>(f) * M;
+        T* yi = bi + static_cast<std::ptrdiff_t>(f) * M;
+        const T* fr = wr + f * (P - 1);
+        const T* fi = wi + f * (P - 1);
+        if constexpr (P == 2)
+        {
+          int k = splitRadix2<V>(xr, xi, yr, yi, M, LM, fr, fi, 0, M);
+          k = splitRadix2<V2>(xr, xi, yr, yi, M, LM, fr, fi, k, M);
+          splitRadix2<T>(xr, xi, yr, yi, M, LM, fr, fi, k, M);
+        }
+        else
+        {
+          T* y1r = yr + (Inverse ? 3 : 1) * LM;
+          T* y1i = yi + (Inverse ? 3 : 1) * LM;
+          T* y3r = yr + (Inverse ? 1 : 3) * LM;
+          T* y3i = yi + (Inverse ? 1 : 3) * LM;
+          int k = splitRadix4<V>(xr, xi, yr, yi, y1r, y1i, yr + 2 * LM, yi + 2 * LM, y3r, y3i, M, fr, fi, 0, M);
+          k = splitRadix4<V2>(xr, xi, yr, yi, y1r, y1i, yr + 2 * LM, yi + 2 * LM, y3r, y3i, M, fr, fi, k, M);
+          splitRadix4<T>(xr, xi, yr, yi, y1r, y1i, yr + 2 * LM, yi + 2 * LM, y3r, y3i, M, fr, fi, k, M);
+        }
+      }
+    }
+    fixedStages<V, V2, T, N, Inverse, L * P, Offset + fixedStageTwiddles(N, L)>(br, bi, ar, ai);
+  }
+}
+
+// Whole unscaled transform of (re, im) in place, (wr, wi) being n scratch samples
+template <typename V, typename V2, typename T, int N, bool Inverse>
+SIMD_INLINE void fixedTransform(T* re, T* im, T* wr, T* wi)
 {
-  const int n = data.size();
-  int log2n = 0;
-  while (n >> log2n != 1)
+  fixedStages<V, V2, T, N, Inverse, 1, 0>(re, im, wr, wi);
+  if constexpr (fixedStageCount(N) % 2 == 1)
   {
-    log2n++;
+    std::copy(wr, wr + N, re);
+    std::copy(wi, wi + N, im);
   }
+}
 
-  std::vector<Complex> temp(n);
+// Per-instruction-set instantiations of fixedTransform
+template <typename T, int N, bool Inverse>
+void fixedTransformScalar(T* re, T* im, T* wr, T* wi)
+{
+  fixedTransform<T, T, T, N, Inverse>(re, im, wr, wi);
+}
 
-  Complex J(0, (inverse ? -1 : 1));
+#if defined(SIMD_X86)
+template <typename T, int N, bool Inverse>
+SIMD_TARGET("sse2") void fixedTransformSse2(T* re, T* im, T* wr, T* wi)
+{
+  fixedTransform<typename simd::Vector<T, 16>::type, T, T, N, Inverse>(re, im, wr, wi);
+}
 
-  for (int i = 0; i < n; ++i)
+template <typename T, int N, bool Inverse>
+SIMD_TARGET("avx2,fma") void fixedTransformAvx2(T* re, T* im, T* wr, T* wi)
+{
+  fixedTransform<typename simd::Vector<T, 32>::type, typename simd::Vector<T, 16>::type, T, N, Inverse>(re, im, wr,
+                                                                                                       wi);
+}
+#endif
+
+#if defined(SIMD_NEON)
+template <typename T, int N, bool Inverse>
+void fixedTransformNeon(T* re, T* im, T* wr, T* wi)
+{
+  fixedTransform<typename simd::Vector<T, 16>::type, T, T, N, Inverse>(re, im, wr, wi);
+}
+#endif
+
+template <typename T>
+using FixedTransformFn = void (*)(T*, T*, T*, T*);
+
+// Function to pick the fixed kernel of one size for an instruction set
+template <typename T, int N, bool Inverse>
+FixedTransformFn<T> fixedTransformFor(simd::Isa isa)
+{
+#if defined(SIMD_X86)
+  if (isa == simd::Isa::AVX2)
+  {
+    return &fixedTransformAvx2<T, N, Inverse>;
+  }
+  if (isa == simd::Isa::SSE2)
+  {
+    return &fixedTransformSse2<T, N, Inverse>;
+  }
+#elif defined(SIMD_NEON)
+  if (isa == simd::Isa::NEON)
   {
-    temp[bitReverse(i, log2n)] = data[i];
+    return &fixedTransformNeon<T, N, Inverse>;
   }
+#endif
+  return &fixedTransformScalar<T, N, Inverse>;
+}
 
-  for (int s = 1; s <= log2n; ++s)
+// Function to get the fixed kernel of size n, or nullptr if n is not one of kFixedSizes
+template <typename T, bool Inverse>
+FixedTransformFn<T> fixedTransform(int n, simd::Isa isa)
+{
+  switch (n)
   {
-    int m = 1 << s;
-    int m2 = m >> 1;
-    Complex w(1, 0);
-    Complex wm = exp(J * (PI / m2));
-    for (int j = 0; j < m2; ++j)
+    case 128:
+      return fixedTransformFor<T, 128, Inverse>(isa);
+    case 256:
+      return fixedTransformFor<T, 256, Inverse>(isa);
+    case 512:
+      return fixedTransformFor<T, 512, Inverse>(isa);
+    case 1024:
+      return fixedTransformFor<T, 1024, Inverse>(isa);
+    case 2048:
+      return fixedTransformFor<T, 2048, Inverse>(isa);
+    default:
+      return nullptr;
+  }
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+// SIMD FFT plan on split real/imaginary arrays, in float or double.
+// Same Stockham algorithm as Plan (which stays the scalar reference); the
+// butterfly kernels are picked once at construction from the running CPU
+// (AVX2 / SSE2 / NEON) or forced with the isa argument. Sizes that need
+// Bluestein are delegated to a reference Plan. kFixedSizes run on their
+// compile-time kernels unless fixedKernels is false.
+template <typename T>
+class SplitPlan
+{
+public:
+  // Buffers needed by execute(), one per caller, so that a single plan can
+  // be shared read-only between threads
+  struct Workspace
+  {
+    std::vector<T> re;
+    std::vector<T> im;
+    std::vector<Complex> fallback;
+  };
+
+  SplitPlan(int n, bool inverse, simd::Isa isa = simd::bestIsa(), bool fixedKernels = true)
+      : n_(n), inverse_(inverse), isa_(simd::Isa::Scalar)
+  {
+    assert(n > 0);
+    std::vector<int> radices;
+    if (!factorize(n, radices))
+    {
+      fallback_ = std::make_shared<const Plan>(n, inverse);
+    }
+
+    const double sign = inverse ? 1.0 : -1.0;
+    int l = 1;
+    for (int p : radices)
     {
-      for (int k = j; k < n; k += m)
+      stages_.push_back({p, l, n / (l * p), twRe_.size()});
+      for (int f = 0; f < l; ++f)
       {
-        Complex t = w * temp[k + m2];
-        Complex u = temp[k];
-        temp[k] = u + t;
-        temp[k + m2] = u - t;
+        for (int r = 1; r < p; ++r)
+        {
+          const double angle = sign * 2.0 * PI * f * r / (l * p);
+          twRe_.push_back(static_cast<T>(std::cos(angle)));
+          twIm_.push_back(static_cast<T>(std::sin(angle)));
+        }
       }
-      w *= wm;
+      l *= p;
+    }
+
+    stageFn_ = &splitStageScalar<T>;
+#if defined(SIMD_X86)
+    if (isa == simd::Isa::AVX2)
+    {
+      stageFn_ = &splitStageAvx2<T>;
+      isa_ = isa;
+    }
+    else if (isa == simd::Isa::SSE2)
+    {
+      stageFn_ = &splitStageSse2<T>;
+      isa_ = isa;
+    }
+#elif defined(SIMD_NEON)
+    if (isa == simd::Isa::NEON)
+    {
+      stageFn_ = &splitStageNeon<T>;
+      isa_ = isa;
     }
+#endif
+    if (fixedKernels)
+    {
+      fixedFn_ = inverse ? fixedTransform<T, true>(n, isa_) : fixedTransform<T, false>(n, isa_);
+    }
+    workspace_ = workspace();
   }
 
-  if (inverse)
+  int size() const { return n_; }
+  bool inverse() const { return inverse_; }
+  simd::Isa isa() const { return isa_; }
+  // True when the size runs on a compile-time kernel
+  bool fixed() const { return fixedFn_ != nullptr; }
+
+  Workspace workspace() const
   {
-    for (int i = 0; i < n; ++i)
+    Workspace ws;
+    if (fallback_)
     {
-      temp[i] /= n;
+      ws.fallback.resize(n_ + fallback_->scratchSize());
     }
+    else
+    {
+      ws.re.resize(n_);
+      ws.im.resize(n_);
+    }
+    return ws;
   }
-  copy(temp.begin(), temp.end(), data.begin());
+
+  // In-place transform of n samples given as real and imaginary arrays
+  void execute(T* re, T* im) { execute(re, im, workspace_); }
+
+  void execute(T* re, T* im, Workspace& ws) const
+  {
+    if (fallback_)
+    {
+      Complex* buffer = ws.fallback.data();
+      for (int i = 0; i < n_; ++i)
+      {
+        buffer[i] = Complex(re[i], im[i]);
+      }
+      fallback_->execute(buffer, 1, buffer + n_);
+      for (int i = 0; i < n_; ++i)
+      {
+        re[i] = static_cast<T>(buffer[i].real());
+        im[i] = static_cast<T>(buffer[i].imag());
+      }
+      return;
+    }
+
+    if (fixedFn_)
+    {
+      fixedFn_(re, im, ws.re.data(), ws.im.data());
+      const T scale = T(1) / n_;
+      for (int i = 0; i < n_ && inverse_; ++i)
+      {
+        re[i] *= scale;
+        im[i] *= scale;
+      }
+      return;
+    }
+
+    // Stages ping-pong between the caller's arrays and the workspace
+    T* ar = re;
+    T* ai = im;
+    T* br = ws.re.data();
+    T* bi = ws.im.data();
+    for (const Stage& st : stages_)
+    {
+      const SplitStage<T> stage{st.radix, st.l, st.m, twRe_.data() + st.twiddleOffset, twIm_.data() + st.twiddleOffset};
+      stageFn_(stage, inverse_, ar, ai, br, bi);
+      std::swap(ar, br);
+      std::swap(ai, bi);
+    }
+
+    const T scale = inverse_ ? T(1) / n_ : T(1);
+    if (ar != re || inverse_)
+    {
+      for (int i = 0; i < n_; ++i)
+      {
+        re[i] = ar[i] * scale;
+        im[i] = ai[i] * scale;
+      }
+    }
+  }
+
+private:
+  struct Stage
+  {
+    int radix;
+    int l;
+    int m;
+    std::size_t twiddleOffset;
+  };
+  using StageFn = void (*)(const SplitStage<T>&, bool, const T*, const T*, T*, T*);
+
+  int n_;
+  bool inverse_;
+  simd::Isa isa_;
+  std::vector<Stage> stages_;
+  std::vector<T> twRe_;
+  std::vector<T> twIm_;
+  StageFn stageFn_;
+  FixedTransformFn<T> fixedFn_ = nullptr;
+  std::shared_ptr<const Plan> fallback_;
+  Workspace workspace_;
+};
+
+// Function to perform 1D FFT
+// One-shot convenience wrapper; build a Plan directly when transforming
+// many vectors of the same size.
+void fft(std::vector<Complex>& data, bool inverse)
+{
+  Plan plan(data.size(), inverse);
+  plan.execute(data);
 }
 
 // Function to perform 2D FFT
+// Rows and columns are transformed in place with one plan per dimension,
+// so no per-row allocations and no transposed copy are needed.
 void fft2d(std::vector<std::vector<Complex>>& data, bool inverse)
 {
   const int rows = data.size();
   const int cols = data[0].size();
 
   // Apply 1D FFT to each row
+  Plan rowPlan(cols, inverse);
   for (int i = 0; i < rows; ++i)
   {
-    fft(data[i], inverse);
+    rowPlan.execute(data[i]);
   }
 
-  // Transpose the data
-  std::vector<std::vector<Complex>> transposed(cols, std::vector<Complex>(rows));
-  for (int i = 0; i < rows; ++i)
+  // Apply 1D FFT to each column
+  Plan colPlan(rows, inverse);
+  std::vector<Complex> column(rows);
+  for (int j = 0; j < cols; ++j)
   {
-    for (int j = 0; j < cols; ++j)
+    for (int i = 0; i < rows; ++i)
+    {
+      column[i] = data[i][j];
+    }
+    colPlan.execute(column);
+    for (int i = 0; i < rows; ++i)
+    {
+      data[i][j] = column[i];
+    }
+  }
+}
+
+// Number of neighbouring columns transformed together by the column pass.
+// 8 complex doubles are 128 bytes, i.e. every row access reads whole cache lines.
+const int kColumnBatch = 8;
+
+// Function to apply a 1D FFT to every row of a row-major matrix.
+// Each row is split into real/imaginary buffers for the SIMD plan. Rows are
+// spread over up to `threads` threads (0 = all cores), each with its own
+// buffers; the plan is shared read-only.
+template <typename T>
+void rowFFTs(const SplitPlan<T>& plan, std::complex<T>* data, int rows, std::ptrdiff_t rowStride, int threads = 1)
+{
+  const int cols = plan.size();
+  threading::defaultPool().parallelFor(
+      rows,
+      [&](int begin, int end, int)
+      {
+        typename SplitPlan<T>::Workspace ws = plan.workspace();
+        std::vector<T> re(cols), im(cols);
+        for (int i = begin; i < end; ++i)
+        {
+          std::complex<T>* r = data + i * rowStride;
+          for (int j = 0; j < cols; ++j)
+          {
+            re[j] = r[j].real();
+            im[j] = r[j].imag();
+          }
+          plan.execute(re.data(), im.data(), ws);
+          for (int j = 0; j < cols; ++j)
+          {
+            r[j] = std::complex<T>(re[j], im[j]);
+          }
+        }
+      },
+      threads);
+}
+
+// Function to apply a 1D FFT to every column of a row-major matrix.
+// Columns are processed in blocks of kColumnBatch: the block is gathered into
+// a small split-format buffer (column after column), transformed and
+// scattered back. The working set is rows * kColumnBatch elements per thread
+// whatever the width, and no transposed copy of the matrix is made.
+template <typename T>
+void columnFFTs(const SplitPlan<T>& plan, std::complex<T>* data, int cols, std::ptrdiff_t rowStride, int threads = 1)
+{
+  const int rows = plan.size();
+  const int blocks = (cols + kColumnBatch - 1) / kColumnBatch;
+  threading::defaultPool().parallelFor(
+      blocks,
+      [&](int begin, int end, int)
+      {
+        std::vector<T> blockRe(static_cast<std::size_t>(rows) * kColumnBatch);
+        std::vector<T> blockIm(blockRe.size());
+        typename SplitPlan<T>::Workspace ws = plan.workspace();
+
+        for (int j0 = begin * kColumnBatch; j0 < std::min(cols, end * kColumnBatch); j0 += kColumnBatch)
+        {
+          const int width = std::min(kColumnBatch, cols - j0);
+          for (int i = 0; i < rows; ++i)
+          {
+            const std::complex<T>* r = data + i * rowStride + j0;
+            for (int b = 0; b < width; ++b)
+            {
+              blockRe[b * rows + i] = r[b].real();
+              blockIm[b * rows + i] = r[b].imag();
+            }
+          }
+
+          for (int b = 0; b < width; ++b)
+          {
+            plan.execute(blockRe.data() + b * rows, blockIm.data() + b * rows, ws);
+          }
+
+          for (int i = 0; i < rows; ++i)
+          {
+            std::complex<T>* r = data + i * rowStride + j0;
+            for (int b = 0; b < width; ++b)
+            {
+              r[b] = std::complex<T>(blockRe[b * rows + i], blockIm[b * rows + i]);
+            }
+          }
+        }
+      },
+      threads);
+}
+
+// Function to perform 2D FFT in place on a contiguous row-major buffer
+// (rowStride elements between the starts of consecutive rows).
+// threads: 0 = all cores, 1 = serial; the result is bitwise the same.
+template <typename T>
+void fft2d(std::complex<T>* data, int rows, int cols, std::ptrdiff_t rowStride, bool inverse, int threads = 0)
+{
+  const SplitPlan<T> rowPlan(cols, inverse);
+  rowFFTs(rowPlan, data, rows, rowStride, threads);
+
+  const SplitPlan<T> colPlan(rows, inverse);
+  columnFFTs(colPlan, data, cols, rowStride, threads);
+}
+
+// Function to perform 2D FFT in place on a CV_64FC2 or CV_32FC2 matrix
+void fft2d(cv::Mat& data, bool inverse, int threads = 0)
+{
+  CV_Assert(data.type() == CV_64FC2 || data.type() == CV_32FC2);
+  if (data.type() == CV_64FC2)
+  {
+    fft2d(reinterpret_cast<Complex*>(data.ptr<cv::Vec2d>(0)), data.rows, data.cols, data.step1() / 2, inverse,
+          threads);
+  }
+  else
+  {
+    fft2d(reinterpret_cast<std::complex<float>*>(data.ptr<cv::Vec2f>(0)), data.rows, data.cols, data.step1() / 2,
+          inverse, threads);
+  }
+}
+
+// Real-input FFT plan. The spectrum of real data is Hermitian
+// (X[n - k] == conj(X[k])), so only the first n/2+1 bins are stored.
+// For even n the n real samples are packed as n/2 complex samples
+// (even -> real, odd -> imaginary) and transformed with a half-size
+// complex FFT, followed by a split step that separates the two halves.
+template <typename T>
+class RealPlan
+{
+public:
+  // Buffers needed by forward()/inverse(), one per caller
+  struct Workspace
+  {
+    std::vector<T> re;
+    std::vector<T> im;
+    typename SplitPlan<T>::Workspace half;
+  };
+
+  RealPlan(int n, bool inverse)
+      : n_(n), inverse_(inverse), half_(n % 2 == 0 ? n / 2 : n, inverse), split_(n / 2 + 1), workspace_(workspace())
+  {
+    const double sign = inverse ? 1.0 : -1.0;
+    for (int k = 0; k <= n / 2; ++k)
+    {
+      split_[k] = std::complex<T>(std::polar(1.0, sign * 2.0 * PI * k / n));
+    }
+  }
+
+  int size() const { return n_; }
+  int spectrumSize() const { return n_ / 2 + 1; }
+
+  Workspace workspace() const
+  {
+    return Workspace{std::vector<T>(half_.size()), std::vector<T>(half_.size()), half_.workspace()};
+  }
+
+  void forward(const T* in, std::complex<T>* out) { forward(in, out, workspace_); }
+  void inverse(const std::complex<T>* in, T* out) { inverse(in, out, workspace_); }
+
+  // n real samples -> n/2+1 complex bins
+  void forward(const T* in, std::complex<T>* out, Workspace& ws) const
+  {
+    assert(!inverse_);
+    std::vector<T>& re = ws.re;
+    std::vector<T>& im = ws.im;
+    if (n_ % 2 != 0)
+    {
+      // Odd sizes cannot be packed; fall back to a full complex transform
+      std::copy(in, in + n_, re.begin());
+      std::fill(im.begin(), im.end(), T(0));
+      half_.execute(re.data(), im.data(), ws.half);
+      for (int k = 0; k < spectrumSize(); ++k)
+      {
+        out[k] = std::complex<T>(re[k], im[k]);
+      }
+      return;
+    }
+
+    const int h = n_ / 2;
+    for (int i = 0; i < h; ++i)
+    {
+      re[i] = in[2 * i];
+      im[i] = in[2 * i + 1];
+    }
+    half_.execute(re.data(), im.data(), ws.half);
+
+    for (int k = 0; k <= h; ++k)
+    {
+      const std::complex<T> z(re[k % h], im[k % h]);
+      const std::complex<T> zc(re[(h - k) % h], -im[(h - k) % h]);
+      const std::complex<T> even = T(0.5) * (z + zc);
+      const std::complex<T> odd = std::complex<T>(0, -0.5) * (z - zc);
+      out[k] = even + split_[k] * odd;
+    }
+  }
+
+  // n/2+1 complex bins -> n real samples (scaled by 1/n)
+  void inverse(const std::complex<T>* in, T* out, Workspace& ws) const
+  {
+    assert(inverse_);
+    std::vector<T>& re = ws.re;
+    std::vector<T>& im = ws.im;
+    if (n_ % 2 != 0)
+    {
+      const int m = spectrumSize();
+      for (int k = 0; k < n_; ++k)
+      {
+        const std::complex<T> x = k < m ? in[k] : std::conj(in[n_ - k]);
+        re[k] = x.real();
+        im[k] = x.imag();
+      }
+      half_.execute(re.data(), im.data(), ws.half);
+      std::copy(re.begin(), re.end(), out);
+      return;
+    }
+
+    const int h = n_ / 2;
+    for (int k = 0; k < h; ++k)
+    {
+      const std::complex<T> x = in[k];
+      const std::complex<T> xc = std::conj(in[h - k]);
+      const std::complex<T> even = T(0.5) * (x + xc);
+      const std::complex<T> odd = T(0.5) * (x - xc) * split_[k];
+      re[k] = even.real() - odd.imag();
+      im[k] = even.imag() + odd.real();
+    }
+    half_.execute(re.data(), im.data(), ws.half);
+
+    for (int i = 0; i < h; ++i)
     {
-      transposed[j][i] = data[i][j];
+      out[2 * i] = re[i];
+      out[2 * i + 1] = im[i];
     }
   }
 
-  // Apply 1D FFT to each column of the transposed data
-  for (int i = 0; i < cols; ++i)
+private:
+  int n_;
+  bool inverse_;
+  SplitPlan<T> half_;
+  std::vector<std::complex<T>> split_;
+  Workspace workspace_;
+};
+
+// Forward and inverse 2D real FFT plans for one image size (rows x cols),
+// for transforming many images of that size (e.g. video frames).
+// Read-only once built, so one plan can serve several threads.
+template <typename T>
+class RealPlan2d
+{
+public:
+  RealPlan2d(int rows, int cols)
+      : rows_(rows), cols_(cols), rowForward_(cols, false), rowInverse_(cols, true), colForward_(rows, false),
+        colInverse_(rows, true)
   {
-    fft(transposed[i], inverse);
   }
 
-  // Transpose back if not in inverse mode
-  if (!inverse)
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+
+  // Real image (any depth) -> half spectrum rows x (cols/2 + 1)
+  void forward(const cv::Mat& src, cv::Mat& dst, int threads = 0) const
+  {
+    CV_Assert(src.channels() == 1 && src.rows == rows_ && src.cols == cols_);
+    const int halfCols = cols_ / 2 + 1;
+    dst.create(rows_, halfCols, CV_MAKETYPE(depth, 2));
+
+    // Real FFT of each row, converting the input one row at a time
+    threading::defaultPool().parallelFor(
+        rows_,
+        [&](int begin, int end, int)
+        {
+          typename RealPlan<T>::Workspace ws = rowForward_.workspace();
+          cv::Mat rowBuffer(1, cols_, depth);
+          for (int i = begin; i < end; ++i)
+          {
+            const T* in = src.ptr<T>(i);
+            if (src.depth() != depth)
+            {
+              src.row(i).convertTo(rowBuffer, depth);
+              in = rowBuffer.ptr<T>(0);
+            }
+            rowForward_.forward(in, reinterpret_cast<std::complex<T>*>(dst.ptr<T>(i)), ws);
+          }
+        },
+        threads);
+
+    // Complex FFT of each of the remaining columns
+    columnFFTs(colForward_, reinterpret_cast<std::complex<T>*>(dst.ptr<T>(0)), halfCols, dst.step1() / 2, threads);
+  }
+
+  // Half spectrum -> real image, scaled by 1/(rows*cols). The column pass
+  // runs in place, so `spectrum` is overwritten.
+  void inverse(cv::Mat& spectrum, cv::Mat& dst, int threads = 0) const
+  {
+    CV_Assert(spectrum.type() == CV_MAKETYPE(depth, 2) && spectrum.rows == rows_ && spectrum.cols == cols_ / 2 + 1);
+    columnFFTs(colInverse_, reinterpret_cast<std::complex<T>*>(spectrum.ptr<T>(0)), spectrum.cols,
+               spectrum.step1() / 2, threads);
+
+    dst.create(rows_, cols_, depth);
+    threading::defaultPool().parallelFor(
+        rows_,
+        [&](int begin, int end, int)
+        {
+          typename RealPlan<T>::Workspace ws = rowInverse_.workspace();
+          for (int i = begin; i < end; ++i)
+          {
+            rowInverse_.inverse(reinterpret_cast<const std::complex<T>*>(spectrum.ptr<T>(i)), dst.ptr<T>(i), ws);
+          }
+        },
+        threads);
+  }
+
+private:
+  static const int depth = std::is_same<T, float>::value ? CV_32F : CV_64F;
+
+  int rows_;
+  int cols_;
+  RealPlan<T> rowForward_;
+  RealPlan<T> rowInverse_;
+  SplitPlan<T> colForward_;
+  SplitPlan<T> colInverse_;
+};
+
+template <typename T>
+void rfft2d(const cv::Mat& src, cv::Mat& dst, int threads)
+{
+  RealPlan2d<T>(src.rows, src.cols).forward(src, dst, threads);
+}
+
+// Function to perform a 2D FFT of a real, single-channel image.
+// The result is the Hermitian half spectrum: rows x (cols/2 + 1), CV_32FC2
+// for 8-bit and float images (single precision is plenty for 8-bit data and
+// doubles the SIMD width), CV_64FC2 otherwise.
+// threads: 0 = all cores, 1 = serial.
+void rfft2d(const cv::Mat& src, cv::Mat& dst, int threads = 0)
+{
+  assert(src.channels() == 1);
+  if (src.depth() == CV_8U || src.depth() == CV_32F)
+  {
+    rfft2d<float>(src, dst, threads);
+  }
+  else
+  {
+    rfft2d<double>(src, dst, threads);
+  }
+}
+
+template <typename T>
+void irfft2d(const cv::Mat& src, cv::Mat& dst, int cols, int threads)
+{
+  // The column pass works in place, so it runs on a copy of the spectrum
+  cv::Mat spectrum = src.clone();
+  RealPlan2d<T>(src.rows, cols).inverse(spectrum, dst, threads);
+}
+
+// Function to perform an inverse 2D FFT of a half spectrum produced by rfft2d.
+// `cols` is the width of the original image (the half spectrum alone cannot
+// tell an even width from an odd one). The result is CV_32F or CV_64F (same
+// precision as the spectrum), scaled by 1/(rows*cols).
+void irfft2d(const cv::Mat& src, cv::Mat& dst, int cols, int threads = 0)
+{
+  CV_Assert((src.type() == CV_32FC2 || src.type() == CV_64FC2) && src.cols == cols / 2 + 1);
+  if (src.type() == CV_32FC2)
+  {
+    irfft2d<float>(src, dst, cols, threads);
+  }
+  else
   {
-    data = transposed;
+    irfft2d<double>(src, dst, cols, threads);
   }
 }
 
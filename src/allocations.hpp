@@ -0,0 +1,80 @@
+/*
+  *allocations.hpp
+    Process-wide count of heap allocations (calls and bytes)
+  *Opt-in: define ALLOCATIONS_WRAP_MALLOC before the first include and, on
+   glibc, the C allocation functions are replaced by counting wrappers
+   around the glibc ones; operator new and cv::Mat buffers go through them
+   too. The benchmark always does this, IMS only when built with the CMake
+   option IMS_COUNT_ALLOCATIONS: the wrappers put two atomic adds on every
+   allocation and do not mix with sanitizers. Otherwise nothing is counted,
+   count() stays 0 and ALLOCATIONS_COUNTED is not defined.
+  *With ALLOCATIONS_WRAP_MALLOC include it from one translation unit of a
+   program only: it defines malloc.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+namespace allocations
+{
+
+// Calls and bytes since the start of the program, over all threads
+inline std::atomic<long long> countTotal(0);
+inline std::atomic<long long> bytesTotal(0);
+
+inline long long count() { return countTotal.load(std::memory_order_relaxed); }
+
+inline long long bytes() { return bytesTotal.load(std::memory_order_relaxed); }
+
+inline void add(std::size_t size)
+{
+  countTotal.fetch_add(1, std::memory_order_relaxed);
+  bytesTotal.fetch_add(static_cast<long long>(size), std::memory_order_relaxed);
+}
+
+} // namespace allocations
+
+#if defined(ALLOCATIONS_WRAP_MALLOC) && defined(__GLIBC__)
+#define ALLOCATIONS_COUNTED 1
+extern "C"
+{
+  void* __libc_malloc(size_t);
+  void* __libc_calloc(size_t, size_t);
+  void* __libc_realloc(void*, size_t);
+  void* __libc_memalign(size_t, size_t);
+
+  void* malloc(size_t size) noexcept
+  {
+    allocations::add(size);
+    return __libc_malloc(size);
+  }
+
+  void* calloc(size_t count, size_t size) noexcept
+  {
+    allocations::add(count * size);
+    return __libc_calloc(count, size);
+  }
+
+  void* realloc(void* pointer, size_t size) noexcept
+  {
+    allocations::add(size);
+    return __libc_realloc(pointer, size);
+  }
+
+  int posix_memalign(void** pointer, size_t alignment, size_t size) noexcept
+  {
+    allocations::add(size);
+    *pointer = __libc_memalign(alignment, size);
+    return *pointer || size == 0 ? 0 : ENOMEM;
+  }
+
+  void* aligned_alloc(size_t alignment, size_t size) noexcept
+  {
+    allocations::add(size);
+    return __libc_memalign(alignment, size);
+  }
+}
+#endif
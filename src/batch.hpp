@@ -0,0 +1,275 @@
+/*
+  *batch.hpp
+    Headless batch mode: filters every image of a directory (or glob) and
+    writes the results, without any window or stdin interaction
+  *Usage:
+     IMS --input <dir|glob> --output <dir> --filter <spec> [--filter <spec> ...] [--threads N]
+   <spec> is "type:D0[:n[:epsilon]]", e.g. "Gaussian HP:5" or "ButterworthLP:40:2".
+   Several --filter options form a chain that is applied as one filter.
+  *Each image is written as <output>/<stem>.png; inputs sharing a stem
+   (a.png and a.jpg, or one name in several glob directories) keep their
+   extension, <stem>_<ext>.png, and a number if that is not enough.
+  *Images are processed concurrently across cores; a per-image and total
+   throughput summary is printed at the end.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "helpers.hpp"
+#include "image_processing.hpp"
+#include "thread_pool.hpp"
+
+namespace batch
+{
+
+struct Options
+{
+  std::string input;  // Directory or glob pattern
+  std::string output; // Output directory
+  std::vector<image_processing::FilterSpec> chain;
+  int threads = 0; // 0 = all cores
+};
+
+// Outcome of one image
+struct Result
+{
+  std::string path;
+  std::string error; // Why it failed
+  int rows = 0;
+  int cols = 0;
+  double ms = 0.0;
+  bool ok = false;
+};
+
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program
+            << " --input <dir|glob> --output <dir> --filter <type:D0[:n[:epsilon]]> [--filter ...] [--threads N]\n";
+  std::cerr << "Filter types:";
+  for (int i = 0; i <= static_cast<int>(image_processing::FilterType::ChebyshevLp); i++)
+  {
+    std::cerr << (i ? ", " : " ") << image_processing::filterName(static_cast<image_processing::FilterType>(i));
+  }
+  std::cerr << "\n";
+}
+
+// Function to parse the command line; false (after printing why) if it is invalid
+bool parseArguments(int argc, char** argv, Options& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      std::cerr << "Error: missing value for " << arg << std::endl;
+      return false;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--input")
+    {
+      options.input = value;
+    }
+    else if (arg == "--output")
+    {
+      options.output = value;
+    }
+    else if (arg == "--filter")
+    {
+      image_processing::FilterSpec spec;
+      if (!image_processing::parseFilterSpec(value, spec))
+      {
+        std::cerr << "Error: invalid filter spec '" << value << "'" << std::endl;
+        return false;
+      }
+      options.chain.push_back(spec);
+    }
+    else if (arg == "--threads")
+    {
+      options.threads = std::atoi(value.c_str());
+    }
+    else
+    {
+      std::cerr << "Error: unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+
+  if (options.input.empty() || options.output.empty() || options.chain.empty())
+  {
+    std::cerr << "Error: --input, --output and at least one --filter are required" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Function to list the input images: every image file of a directory, or
+// the matches of a glob pattern
+std::vector<std::string> listImages(const std::string& input)
+{
+  std::vector<std::string> files;
+  if (!std::filesystem::is_directory(input))
+  {
+    cv::glob(input, files, false);
+    return files;
+  }
+
+  const std::vector<std::string> extensions = {".png", ".jpg", ".jpeg", ".bmp", ".tif",
+                                               ".tiff", ".pgm", ".ppm", ".webp"};
+  for (const auto& entry : std::filesystem::directory_iterator(input))
+  {
+    std::string extension = entry.path().extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (entry.is_regular_file() && std::find(extensions.begin(), extensions.end(), extension) != extensions.end())
+    {
+      files.push_back(entry.path().string());
+    }
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// Function to name the output of every input, <stem>.png unless stems collide
+std::vector<std::string> outputNames(const std::vector<std::string>& files)
+{
+  std::map<std::string, int> stems;
+  for (const std::string& file : files)
+  {
+    stems[std::filesystem::path(file).stem().string()]++;
+  }
+
+  std::vector<std::string> names;
+  std::set<std::string> used;
+  for (const std::string& file : files)
+  {
+    const std::filesystem::path path(file);
+    std::string base = path.stem().string();
+    if (stems[base] > 1 && path.has_extension())
+    {
+      base += "_" + path.extension().string().substr(1);
+    }
+    std::string name = base + ".png";
+    for (int copy = 2; used.count(name); copy++)
+    {
+      name = base + "_" + std::to_string(copy) + ".png";
+    }
+    used.insert(name);
+    names.push_back(name);
+  }
+  return names;
+}
+
+// Function to filter one image and save it as <output>/<name>
+Result processImage(const std::string& path, const std::string& name, const Options& options, int threads)
+{
+  const auto start = std::chrono::steady_clock::now();
+  Result result;
+  result.path = path;
+
+  cv::Mat imgIn = cv::imread(path, cv::IMREAD_GRAYSCALE);
+  if (imgIn.empty())
+  {
+    result.error = "could not read " + path;
+    return result;
+  }
+  result.rows = imgIn.rows;
+  result.cols = imgIn.cols;
+
+  cv::Mat imgOut = image_processing::filterImage(imgIn, options.chain, threads);
+  imgOut.convertTo(imgOut, CV_8U, 255);
+
+  const std::filesystem::path outPath = std::filesystem::path(options.output) / name;
+  if (!helpers::saveImage(imgOut, outPath.string()))
+  {
+    result.error = "could not write " + outPath.string();
+    return result;
+  }
+
+  result.ok = true;
+  result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+// Function to run the batch; returns the process exit code
+int run(const Options& options)
+{
+  const std::vector<std::string> files = listImages(options.input);
+  if (files.empty())
+  {
+    std::cerr << "Error: no images found in " << options.input << std::endl;
+    return 1;
+  }
+  std::filesystem::create_directories(options.output);
+  const std::vector<std::string> names = outputNames(files);
+
+  // Whole images are spread over the threads; the FFTs inside an image only
+  // run in parallel when there are fewer images than threads
+  threading::ThreadPool& pool = threading::defaultPool();
+  const int threads = options.threads > 0 ? std::min(options.threads, pool.size()) : pool.size();
+  const int imageThreads = static_cast<int>(files.size()) >= threads ? 1 : threads;
+
+  // Each thread takes the next unprocessed image, so a few large images do
+  // not leave the other threads idle
+  std::vector<Result> results(files.size());
+  std::atomic<int> next(0);
+  const auto start = std::chrono::steady_clock::now();
+  pool.parallelFor(
+      threads,
+      [&](int, int, int)
+      {
+        for (int i = next++; i < static_cast<int>(files.size()); i = next++)
+        {
+          results[i] = processImage(files[i], names[i], options, imageThreads);
+        }
+      },
+      threads);
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  int failed = 0;
+  double pixels = 0.0;
+  std::cout << std::fixed << std::setprecision(2);
+  for (const Result& result : results)
+  {
+    if (!result.ok)
+    {
+      std::cerr << "Error: " << result.error << std::endl;
+      failed++;
+      continue;
+    }
+    const double mpix = result.rows * static_cast<double>(result.cols) / 1e6;
+    pixels += mpix;
+    std::cout << result.path << "  " << result.cols << "x" << result.rows << "  " << result.ms << " ms  "
+              << mpix / (result.ms / 1000.0) << " MPix/s\n";
+  }
+
+  const int done = static_cast<int>(results.size()) - failed;
+  std::cout << "Processed " << done << " images (" << failed << " failed) in " << seconds << " s on " << threads
+            << " threads: " << done / seconds << " images/s, " << pixels / seconds << " MPix/s" << std::endl;
+  return failed ? 1 : 0;
+}
+
+// Entry point of the batch mode
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!parseArguments(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+  return run(options);
+}
+
+} // namespace batch
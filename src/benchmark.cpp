@@ -0,0 +1,819 @@
+/*
+  *benchmark.cpp
+    Standalone benchmarks (target IMS_benchmark)
+  *Usage: IMS_benchmark [fft] [haar] [haar-scaling] [dwt] [codec] [dct] [conv] [suite] [--threads N]
+         (no section = all; anything else is an error, exit code 1)
+         [--sizes 256,512,...] [--json <file>] [--baseline <file>] [--tolerance 0.10]
+  *fft: thread scaling of the 2D FFT of 1K, 4K and 8K images with 1, 2, 4, ...
+   threads up to the number of cores; every run must give the same bits as
+   the single-threaded one.
+  *haar: in-place lifting Haar (haarForward/haarInverse) against
+   cvHaarWavelet/cvInvHaarWavelet, 3 levels, 512 to 4096.
+  *haar-scaling: thread scaling of cvHaarWavelet and cvInvHaarWavelet
+   (3 levels, row bands per level) on 4K, 8K and 16K images with 1, 2, 4,
+   ... threads; the coefficients and the reconstruction must have the same
+   bits as the single-threaded ones. 16K needs about 3 GiB.
+  *dwt: lifting DWT of every family (dwt.hpp), 3 levels, forward + inverse
+   at 1000 and 2048 (non power of two and power of two), with the
+   reconstruction error.
+  *codec: the wavelet codec (codec.hpp) at 0.25 to 2 bpp against
+   cv::imencode JPEG (quality 25 to 95) and PNG on ../images/lena_gray.png:
+   size, PSNR and encode/decode throughput (the IMSW encode time is for the
+   step the bitrate search found, i.e. one pass).
+  *dct: 8x8 block DCT round trip (block_dct.hpp) at several qualities
+   against the wavelet route (5-level CDF 9/7, quantize, inverse) at several
+   steps on the same image: PSNR, share of nonzero coefficients, MPix/s.
+  *conv: convolution::filter2D (route picked by the cost model) against
+   cv::filter2D for box (rank 1) and random kernels of 3x3 to 101x101 on a
+   1024x1024 8-bit image, with the largest difference between the two.
+  *suite: the main kernels (FFT::fft2d, the same without the compile-time
+   kernels of FFT::kFixedSizes, and cv::dft, construct_H for every
+   filter, filtering (separable Gaussian and radial Butterworth gains),
+   reverseDTF, filterImage (recursive Gaussian), cvHaarWavelet/cvInvHaarWavelet,
+   shrinkSubbands and the BayesShrink/SURE estimators, generateHistogram) on square images of --sizes (256 to 8192 by
+   default): ns/pixel, MPix/s and heap allocations per call (counted on
+   glibc by wrapping malloc & co., which cv::Mat buffers also go through;
+   only this program turns the wrappers on, see allocations.hpp).
+   --json writes the results; --baseline compares them with an earlier
+   --json file and exits with 2 if a kernel got slower by more than
+   --tolerance (a fraction, 10% by default).
+  *--threads N caps the threads of fft and haar-scaling (largest count) and
+   of suite (all kernels, OpenCV's included); haar, dwt, codec, dct and
+   conv run with their defaults.
+*/
+
+// Count heap allocations in this program (allocations.hpp), before any include pulls it in
+#define ALLOCATIONS_WRAP_MALLOC 1
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FFT.hpp"
+#include "allocations.hpp"
+#include "block_dct.hpp"
+#include "codec.hpp"
+#include "convolution.hpp"
+#include "dwt.hpp"
+#include "image_processing.hpp"
+#include "metrics.hpp"
+#include "shrinkage.hpp"
+#include "wavelets.hpp"
+
+// Function to check that two matrices hold exactly the same bytes
+bool bitwiseEqual(const cv::Mat& a, const cv::Mat& b)
+{
+  if (a.size() != b.size() || a.type() != b.type())
+  {
+    return false;
+  }
+  const std::size_t rowBytes = a.cols * a.elemSize();
+  for (int i = 0; i < a.rows; ++i)
+  {
+    if (std::memcmp(a.ptr(i), b.ptr(i), rowBytes) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Function to time `fn` and return the best of `repeats` runs in milliseconds
+template <typename F>
+double bestTimeMs(F&& fn, int repeats)
+{
+  double best = 1e300;
+  for (int r = 0; r < repeats; ++r)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    const auto stop = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(stop - start).count());
+  }
+  return best;
+}
+
+// Function to measure 2D FFT scaling over thread counts for one image size
+bool benchmarkFFTScaling(int size, int maxThreads)
+{
+  cv::Mat input(size, size, CV_32FC2);
+  cv::randu(input, cv::Scalar::all(-1.0), cv::Scalar::all(1.0));
+  const int repeats = size >= 8192 ? 2 : 4;
+
+  cv::Mat reference;
+  double serialMs = 0.0;
+  bool identical = true;
+  std::vector<int> threadCounts;
+  for (int threads = 1; threads < maxThreads; threads *= 2)
+  {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  for (int threads : threadCounts)
+  {
+    cv::Mat data;
+    const double ms = bestTimeMs(
+        [&]
+        {
+          input.copyTo(data);
+          FFT::fft2d(data, false, threads);
+        },
+        repeats);
+
+    bool same = true;
+    if (threads == 1)
+    {
+      reference = data;
+      serialMs = ms;
+    }
+    else
+    {
+      same = bitwiseEqual(data, reference);
+      identical = identical && same;
+    }
+
+    std::cout << std::setw(6) << size << std::setw(9) << threads << std::setw(12) << std::fixed << std::setprecision(2)
+              << ms << std::setw(10) << serialMs / ms << "x" << (same ? "" : "   MISMATCH") << std::endl;
+  }
+  return identical;
+}
+
+// Function to hash the bytes of a matrix (FNV-1a over 64-bit words), so large
+// results can be compared without keeping a copy
+std::uint64_t checksum(const cv::Mat& m)
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  const std::size_t rowBytes = m.cols * m.elemSize();
+  for (int i = 0; i < m.rows; ++i)
+  {
+    const unsigned char* row = m.ptr(i);
+    for (std::size_t j = 0; j < rowBytes; j += sizeof(std::uint64_t))
+    {
+      std::uint64_t word = 0;
+      std::memcpy(&word, row + j, std::min(sizeof(word), rowBytes - j));
+      hash = (hash ^ word) * 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+// Function to measure cvHaarWavelet/cvInvHaarWavelet scaling over thread
+// counts for one image size. The inverse reads the transformed copy the
+// forward leaves in its source, so three images are live at a time.
+bool benchmarkHaarScaling(int size, int maxThreads)
+{
+  const int levels = 3;
+  cv::Mat input(size, size, CV_32F);
+  cv::randu(input, cv::Scalar::all(0.0), cv::Scalar::all(255.0));
+  cv::Mat work(input.size(), CV_32F);
+  cv::Mat coefficients(input.size(), CV_32F);
+  const int repeats = size >= 16384 ? 1 : size >= 8192 ? 2 : 3;
+
+  std::uint64_t forwardReference = 0;
+  std::uint64_t inverseReference = 0;
+  double serialMs = 0.0;
+  bool identical = true;
+  std::vector<int> threadCounts;
+  for (int threads = 1; threads < maxThreads; threads *= 2)
+  {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  for (int threads : threadCounts)
+  {
+    double forwardMs = std::numeric_limits<double>::max();
+    double inverseMs = std::numeric_limits<double>::max();
+    std::uint64_t forwardHash = 0;
+    for (int r = 0; r < repeats; r++)
+    {
+      input.copyTo(work);
+      auto start = std::chrono::steady_clock::now();
+      wavelets::cvHaarWavelet(work, coefficients, levels, threads);
+      auto stop = std::chrono::steady_clock::now();
+      forwardMs = std::min(forwardMs, std::chrono::duration<double, std::milli>(stop - start).count());
+      forwardHash = checksum(coefficients);
+
+      start = std::chrono::steady_clock::now();
+      wavelets::cvInvHaarWavelet(work, coefficients, levels, NONE, 0, threads);
+      stop = std::chrono::steady_clock::now();
+      inverseMs = std::min(inverseMs, std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+    const std::uint64_t inverseHash = checksum(coefficients);
+
+    bool same = true;
+    if (threads == 1)
+    {
+      forwardReference = forwardHash;
+      inverseReference = inverseHash;
+      serialMs = forwardMs + inverseMs;
+    }
+    else
+    {
+      same = forwardHash == forwardReference && inverseHash == inverseReference;
+      identical = identical && same;
+    }
+
+    std::cout << std::setw(6) << size << std::setw(9) << threads << std::setw(14) << std::fixed
+              << std::setprecision(2) << forwardMs << std::setw(14) << inverseMs << std::setw(10)
+              << serialMs / (forwardMs + inverseMs) << "x" << std::setw(12) << std::setprecision(6)
+              << cv::norm(input, coefficients, cv::NORM_INF) << (same ? "" : "   MISMATCH") << std::endl;
+  }
+  return identical;
+}
+
+// Function to compare the in-place Haar transforms with the original ones
+void benchmarkHaar()
+{
+  const int levels = 3;
+  std::cout << "Haar wavelet, " << levels << " levels (forward + inverse)" << std::endl;
+  std::cout << std::setw(6) << "size" << std::setw(14) << "original ms" << std::setw(14) << "in-place ms"
+            << std::setw(11) << "speedup" << std::setw(12) << "max diff" << std::endl;
+  for (int size : {512, 1024, 2048, 4096})
+  {
+    cv::Mat image(size, size, CV_32F);
+    cv::randu(image, cv::Scalar::all(0.0), cv::Scalar::all(255.0));
+    const int repeats = size >= 4096 ? 2 : 5;
+
+    cv::Mat original;
+    const double originalMs = bestTimeMs(
+        [&]
+        {
+          cv::Mat src = image.clone();
+          cv::Mat coefficients(image.size(), CV_32F);
+          wavelets::cvHaarWavelet(src, coefficients, levels);
+          original.create(image.size(), CV_32F);
+          wavelets::cvInvHaarWavelet(coefficients, original, levels);
+        },
+        repeats);
+
+    cv::Mat inPlace;
+    const double inPlaceMs = bestTimeMs(
+        [&]
+        {
+          inPlace = image.clone();
+          wavelets::haarForward(inPlace, levels);
+          wavelets::haarInverse(inPlace, levels);
+        },
+        repeats);
+
+    std::cout << std::setw(6) << size << std::setw(14) << std::fixed << std::setprecision(2) << originalMs
+              << std::setw(14) << inPlaceMs << std::setw(10) << originalMs / inPlaceMs << "x" << std::setw(12)
+              << std::setprecision(6) << cv::norm(original, inPlace, cv::NORM_INF) << std::endl;
+  }
+}
+
+void benchmarkDwt()
+{
+  const int levels = 3;
+  std::cout << "Lifting DWT, " << levels << " levels (forward + inverse)" << std::endl;
+  std::cout << std::setw(14) << "family" << std::setw(6) << "size" << std::setw(12) << "ms" << std::setw(12)
+            << "max error" << std::endl;
+  for (wavelets::Family family : {wavelets::Family::CDF53, wavelets::Family::CDF97, wavelets::Family::Daubechies4,
+                                  wavelets::Family::Daubechies8})
+  {
+    for (int size : {1000, 2048})
+    {
+      cv::Mat image(size, size, CV_32F);
+      cv::randu(image, cv::Scalar::all(0.0), cv::Scalar::all(255.0));
+      cv::Mat restored;
+      const double ms = bestTimeMs(
+          [&]
+          {
+            restored = image.clone();
+            wavelets::dwtForward(restored, family, levels);
+            wavelets::dwtInverse(restored, family, levels);
+          },
+          5);
+      std::cout << std::setw(14) << wavelets::familyName(family) << std::setw(6) << size << std::setw(12)
+                << std::fixed << std::setprecision(2) << ms << std::setw(12) << std::setprecision(6)
+                << cv::norm(image, restored, cv::NORM_INF) << std::endl;
+    }
+  }
+}
+
+// Function to print one line of the codec comparison
+void printCodecRow(const std::string& format, const std::string& setting, std::size_t bytes, const cv::Mat& image,
+                   const cv::Mat& decoded, double encodeMs, double decodeMs)
+{
+  const double mpix = image.total() / 1e6;
+  std::cout << std::setw(6) << format << std::setw(12) << setting << std::setw(10) << bytes << std::setw(8)
+            << std::fixed << std::setprecision(3) << bytes * 8.0 / image.total() << std::setw(9)
+            << std::setprecision(2) << metrics::psnr(image, decoded) << std::setw(12) << mpix / (encodeMs / 1000.0)
+            << std::setw(12) << mpix / (decodeMs / 1000.0) << std::endl;
+}
+
+void benchmarkCodec()
+{
+  cv::Mat image = cv::imread("../images/lena_gray.png", cv::IMREAD_GRAYSCALE);
+  if (image.empty())
+  {
+    std::cerr << "Error: could not read ../images/lena_gray.png, skipping the codec benchmark" << std::endl;
+    return;
+  }
+  std::cout << "Codec comparison on lena_gray.png (" << image.cols << "x" << image.rows << ")" << std::endl;
+  std::cout << std::setw(6) << "format" << std::setw(12) << "setting" << std::setw(10) << "bytes" << std::setw(8)
+            << "bpp" << std::setw(9) << "PSNR" << std::setw(12) << "enc MPix/s" << std::setw(12) << "dec MPix/s"
+            << std::endl;
+
+  for (double bpp : {0.25, 0.5, 1.0, 2.0})
+  {
+    codec::Options options;
+    options.targetBpp = bpp;
+    std::vector<uint8_t> data;
+    float step;
+    if (!codec::encode(image, options, data, step))
+    {
+      continue;
+    }
+    options.step = step;
+    options.targetBpp = 0.0;
+    const double encodeMs = bestTimeMs([&] { codec::encode(image, options, data, step); }, 5);
+    cv::Mat decoded;
+    const double decodeMs = bestTimeMs([&] { codec::decode(data, decoded); }, 5);
+    std::ostringstream setting;
+    setting << bpp << " bpp";
+    printCodecRow("IMSW", setting.str(), data.size(), image, decoded, encodeMs, decodeMs);
+  }
+
+  for (int quality : {25, 50, 75, 95})
+  {
+    std::vector<uchar> data;
+    const std::vector<int> parameters = {cv::IMWRITE_JPEG_QUALITY, quality};
+    const double encodeMs = bestTimeMs([&] { cv::imencode(".jpg", image, data, parameters); }, 5);
+    cv::Mat decoded;
+    const double decodeMs = bestTimeMs([&] { decoded = cv::imdecode(data, cv::IMREAD_GRAYSCALE); }, 5);
+    printCodecRow("JPEG", "q" + std::to_string(quality), data.size(), image, decoded, encodeMs, decodeMs);
+  }
+
+  std::vector<uchar> data;
+  const double encodeMs = bestTimeMs([&] { cv::imencode(".png", image, data); }, 5);
+  cv::Mat decoded;
+  const double decodeMs = bestTimeMs([&] { decoded = cv::imdecode(data, cv::IMREAD_GRAYSCALE); }, 5);
+  printCodecRow("PNG", "lossless", data.size(), image, decoded, encodeMs, decodeMs);
+}
+
+void benchmarkDct()
+{
+  cv::Mat image = cv::imread("../images/lena_gray.png", cv::IMREAD_GRAYSCALE);
+  if (image.empty())
+  {
+    std::cerr << "Error: could not read ../images/lena_gray.png, skipping the DCT benchmark" << std::endl;
+    return;
+  }
+  std::cout << "Block DCT against wavelets (round trip) on lena_gray.png (" << image.cols << "x" << image.rows << ")"
+            << std::endl;
+  std::cout << std::setw(8) << "route" << std::setw(10) << "setting" << std::setw(9) << "PSNR" << std::setw(10)
+            << "nonzero" << std::setw(10) << "MPix/s" << std::endl;
+  const double mpix = image.total() / 1e6;
+  auto printRow = [&](const char* route, const std::string& setting, const cv::Mat& restored, const cv::Mat& q,
+                      double ms)
+  {
+    std::cout << std::setw(8) << route << std::setw(10) << setting << std::setw(9) << std::fixed
+              << std::setprecision(2) << metrics::psnr(image, restored) << std::setw(9)
+              << 100.0 * cv::countNonZero(q) / q.total() << "%" << std::setw(10) << mpix / (ms / 1000.0)
+              << std::endl;
+  };
+
+  for (int quality : {25, 50, 75, 95})
+  {
+    cv::Mat coefficients, restored;
+    const double ms = bestTimeMs([&] { restored = dct::roundTrip(image, quality, coefficients); }, 5);
+    printRow("DCT 8x8", "q" + std::to_string(quality), restored, coefficients, ms);
+  }
+
+  const int levels = 5;
+  for (float step : {32.0f, 16.0f, 8.0f, 2.0f})
+  {
+    cv::Mat q, restored;
+    const double ms = bestTimeMs(
+        [&]
+        {
+          cv::Mat coefficients;
+          image.convertTo(coefficients, CV_32F, 1.0, -128.0);
+          wavelets::dwtForward(coefficients, wavelets::Family::CDF97, levels);
+          codec::quantize(coefficients, step, q);
+          codec::dequantize(q, step, coefficients);
+          restored = codec::reconstruct(coefficients, wavelets::Family::CDF97, levels);
+        },
+        5);
+    std::ostringstream setting;
+    setting << "step " << step;
+    printRow("CDF 9/7", setting.str(), restored, q, ms);
+  }
+}
+
+void benchmarkConvolution()
+{
+  const int n = 1024;
+  cv::Mat image(n, n, CV_8U);
+  cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+  const convolution::CostModel& model = convolution::costModel();
+  std::cout << "Spatial convolution, " << n << "x" << n << " 8-bit (cost model: direct " << std::setprecision(3)
+            << model.directPerTap << " ns/tap, large " << model.directDftPerPoint << " ns/point, separable "
+            << model.separablePerTap << " ns/tap, FFT " << model.fftPerPoint << " ns/point)" << std::endl;
+  std::cout << std::setw(8) << "kernel" << std::setw(8) << "type" << std::setw(11) << "route" << std::setw(6) << "tile"
+            << std::setw(14) << "filter2D ms" << std::setw(10) << "ours ms" << std::setw(9) << "speedup"
+            << std::setw(9) << "max diff" << std::endl;
+  for (int size : {3, 7, 15, 31, 61, 101})
+  {
+    cv::Mat box = cv::Mat::ones(size, size, CV_32F) / static_cast<float>(size * size);
+    cv::Mat random(size, size, CV_32F);
+    cv::randu(random, cv::Scalar::all(0), cv::Scalar::all(1));
+    random = random / cv::sum(random)[0];
+    for (const auto& [type, kernel] : {std::make_pair("box", box), std::make_pair("random", random)})
+    {
+      cv::Mat expected, result;
+      const double reference = bestTimeMs([&] { cv::filter2D(image, expected, -1, kernel); }, 3);
+      const double ours = bestTimeMs([&] { convolution::filter2D(image, result, kernel); }, 3);
+      const convolution::Choice choice = convolution::choose(image.size(), kernel, image.depth());
+      std::ostringstream name;
+      name << size << "x" << size;
+      std::cout << std::setw(8) << name.str() << std::setw(8) << type << std::setw(11)
+                << convolution::methodName(choice.method) << std::setw(6) << choice.tile << std::setw(14) << std::fixed
+                << std::setprecision(2) << reference << std::setw(10) << ours << std::setw(8) << reference / ours
+                << "x" << std::setw(9) << std::setprecision(0) << cv::norm(expected, result, cv::NORM_INF)
+                << std::endl;
+    }
+  }
+}
+
+// One kernel timed at one image size
+struct Measurement
+{
+  std::string kernel;
+  int size = 0;
+  double ms = 0.0;
+  double allocations = -1.0; // Per call, -1 when allocations are not counted
+  double bytes = -1.0;
+
+  double nsPerPixel() const { return ms * 1e6 / (static_cast<double>(size) * size); }
+  double mpixPerSecond() const { return static_cast<double>(size) * size / 1e6 / (ms / 1000.0); }
+};
+
+// Function to time fn (best of `repeats` calls) and count its allocations per call
+template <typename F>
+Measurement measure(const std::string& kernel, int size, int repeats, F&& fn)
+{
+  Measurement m;
+  m.kernel = kernel;
+  m.size = size;
+  const long long count = allocations::count();
+  const long long bytes = allocations::bytes();
+  m.ms = bestTimeMs(fn, repeats);
+#if defined(ALLOCATIONS_COUNTED)
+  m.allocations = static_cast<double>(allocations::count() - count) / repeats;
+  m.bytes = static_cast<double>(allocations::bytes() - bytes) / repeats;
+#endif
+  return m;
+}
+
+void printMeasurement(const Measurement& m)
+{
+  std::cout << std::setw(28) << m.kernel << std::setw(6) << m.size << std::setw(12) << std::fixed
+            << std::setprecision(2) << m.ms << std::setw(10) << m.nsPerPixel() << std::setw(10) << m.mpixPerSecond()
+            << std::setw(10) << std::setprecision(1) << m.allocations << std::setw(12) << std::setprecision(2)
+            << m.bytes / (1 << 20) << std::endl;
+}
+
+// Function to time every kernel of the suite at one size on `threads`
+// threads of the shared pool (OpenCV's own kernels use cv::setNumThreads)
+std::vector<Measurement> runSuite(int size, int threads)
+{
+  const int repeats = size >= 8192 ? 1 : size >= 2048 ? 2 : 5;
+  std::vector<Measurement> results;
+  auto add = [&](const Measurement& m)
+  {
+    printMeasurement(m);
+    results.push_back(m);
+  };
+
+  cv::Mat image(size, size, CV_8U);
+  cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+
+  {
+    cv::Mat complexInput(size, size, CV_32FC2);
+    cv::randu(complexInput, cv::Scalar::all(-1.0), cv::Scalar::all(1.0));
+    cv::Mat data;
+    add(measure("fft2d", size, repeats,
+                [&]
+                {
+                  complexInput.copyTo(data);
+                  FFT::fft2d(data, false, threads);
+                }));
+    add(measure("cv::dft", size, repeats, [&] { cv::dft(complexInput, data); }));
+
+    // fft2d with the compile-time kernels turned off (FFT::kFixedSizes)
+    const FFT::SplitPlan<float> generic(size, false, simd::bestIsa(), false);
+    add(measure("fft2d/generic", size, repeats,
+                [&]
+                {
+                  complexInput.copyTo(data);
+                  std::complex<float>* p = reinterpret_cast<std::complex<float>*>(data.ptr<cv::Vec2f>(0));
+                  FFT::rowFFTs(generic, p, size, data.step1() / 2, threads);
+                  FFT::columnFFTs(generic, p, size, data.step1() / 2, threads);
+                }));
+  }
+
+  for (int i = 0; i <= static_cast<int>(image_processing::FilterType::ChebyshevLp); i++)
+  {
+    const image_processing::FilterSpec spec{static_cast<image_processing::FilterType>(i), 30.0f, 2, 0.5f};
+    cv::Mat H;
+    add(measure(std::string("construct_H/") + image_processing::filterName(spec.type), size, repeats,
+                [&] { H = image_processing::construct_H(image, spec); }));
+  }
+
+  cv::Mat spectrum;
+  image_processing::calculateDFT(image, spectrum, threads);
+  cv::Mat filtered;
+  const image_processing::FilterSpec gaussian{image_processing::FilterType::GaussianLp, 30.0f};
+  add(measure("filtering", size, repeats,
+              [&] { image_processing::filtering(spectrum, filtered, gaussian, image.cols, threads); }));
+  const image_processing::FilterSpec butterworth{image_processing::FilterType::ButterworthLp, 30.0f, 2};
+  add(measure("filtering/radial", size, repeats,
+              [&] { image_processing::filtering(spectrum, filtered, butterworth, image.cols, threads); }));
+  cv::Mat restored;
+  add(measure("reverseDTF", size, repeats,
+              [&] { restored = image_processing::reverseDTF(filtered, image.cols, threads); }));
+  add(measure("filterImage/Gaussian LP", size, repeats,
+              [&] { restored = image_processing::filterImage(image, {gaussian}, threads); }));
+
+  {
+    const int levels = 3;
+    cv::Mat source, coefficients, inverse;
+    image.convertTo(source, CV_32F);
+    cv::Mat work;
+    add(measure("cvHaarWavelet", size, repeats,
+                [&]
+                {
+                  source.copyTo(work);
+                  coefficients.create(source.size(), CV_32F);
+                  wavelets::cvHaarWavelet(work, coefficients, levels, threads);
+                }));
+    add(measure("cvInvHaarWavelet", size, repeats,
+                [&]
+                {
+                  coefficients.copyTo(work);
+                  inverse.create(source.size(), CV_32F);
+                  wavelets::cvInvHaarWavelet(work, inverse, levels, NONE, 50, threads);
+                }));
+    const std::vector<cv::Rect> subbands = shrinkage::haarSubbands(source.size(), levels);
+    add(measure("shrinkSubbands/garrot", size, repeats,
+                [&]
+                {
+                  coefficients.copyTo(work);
+                  shrinkage::shrinkSubbands(work, subbands, GARROT, 30.0f, threads);
+                }));
+    for (shrinkage::Estimator estimator : {shrinkage::Estimator::Bayes, shrinkage::Estimator::Sure})
+    {
+      add(measure(std::string("estimateThresholds/") + shrinkage::estimatorName(estimator), size, repeats,
+                  [&] { shrinkage::estimateThresholds(coefficients, subbands, estimator, threads); }));
+    }
+  }
+
+  cv::Mat histogram;
+  add(measure("generateHistogram", size, repeats, [&] { histogram = image_processing::generateHistogram(image); }));
+  return results;
+}
+
+// Function to write the measurements as JSON, one result per line
+bool writeJson(const std::string& path, const std::vector<Measurement>& results, int threads)
+{
+  std::ofstream file(path);
+  file << "{\n  \"isa\": \"" << simd::isaName(simd::bestIsa()) << "\",\n  \"threads\": " << threads
+       << ",\n  \"results\": [\n";
+  file << std::setprecision(6);
+  for (std::size_t i = 0; i < results.size(); i++)
+  {
+    const Measurement& m = results[i];
+    file << "    {\"kernel\": \"" << m.kernel << "\", \"size\": " << m.size << ", \"ms\": " << m.ms
+         << ", \"ns_per_pixel\": " << m.nsPerPixel() << ", \"mpix_per_s\": " << m.mpixPerSecond()
+         << ", \"allocations\": " << m.allocations << ", \"allocated_bytes\": " << m.bytes << "}"
+         << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  file << "  ]\n}\n";
+  return static_cast<bool>(file);
+}
+
+// Function to read the kernel, size and time of every result of a writeJson file
+bool readJson(const std::string& path, std::vector<Measurement>& results)
+{
+  std::ifstream file(path);
+  if (!file)
+  {
+    return false;
+  }
+  auto field = [](const std::string& line, const std::string& name)
+  {
+    const std::size_t start = line.find("\"" + name + "\": ");
+    return start == std::string::npos ? std::string() : line.substr(start + name.size() + 4);
+  };
+  std::string line;
+  while (std::getline(file, line))
+  {
+    const std::string kernel = field(line, "kernel");
+    if (kernel.size() < 2)
+    {
+      continue;
+    }
+    Measurement m;
+    m.kernel = kernel.substr(1, kernel.find('"', 1) - 1);
+    m.size = std::atoi(field(line, "size").c_str());
+    m.ms = std::atof(field(line, "ms").c_str());
+    results.push_back(m);
+  }
+  return true;
+}
+
+// Function to compare results with a baseline; returns the number of regressions
+int compareWithBaseline(const std::vector<Measurement>& results, const std::vector<Measurement>& baseline,
+                        double tolerance)
+{
+  std::cout << "Comparison with the baseline (tolerance " << tolerance * 100.0 << "%)" << std::endl;
+  std::cout << std::setw(28) << "kernel" << std::setw(6) << "size" << std::setw(14) << "base ns/px" << std::setw(10)
+            << "ns/px" << std::setw(10) << "change" << std::endl;
+  int regressions = 0;
+  for (const Measurement& m : results)
+  {
+    auto match = std::find_if(baseline.begin(), baseline.end(),
+                              [&](const Measurement& b) { return b.kernel == m.kernel && b.size == m.size; });
+    if (match == baseline.end() || match->ms <= 0.0)
+    {
+      continue;
+    }
+    const double change = m.nsPerPixel() / match->nsPerPixel() - 1.0;
+    const bool regression = change > tolerance;
+    regressions += regression;
+    std::cout << std::setw(28) << m.kernel << std::setw(6) << m.size << std::setw(14) << std::fixed
+              << std::setprecision(2) << match->nsPerPixel() << std::setw(10) << m.nsPerPixel() << std::setw(9)
+              << std::showpos << change * 100.0 << std::noshowpos << "%" << (regression ? "  REGRESSION" : "")
+              << std::endl;
+  }
+  return regressions;
+}
+
+// Sections that can be picked on the command line
+const std::vector<std::string> kSections = {"fft", "haar", "haar-scaling", "dwt", "codec", "dct", "conv", "suite"};
+
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program << " [section ...] [--threads N] [--sizes 256,512,...] [--json <file>]"
+            << " [--baseline <file>] [--tolerance 0.10]\n";
+  std::cerr << "Sections:";
+  for (const std::string& section : kSections)
+  {
+    std::cerr << " " << section;
+  }
+  std::cerr << " (none = all)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::string> sections;
+  std::vector<int> sizes = {256, 512, 1024, 2048, 4096, 8192};
+  std::string jsonPath;
+  std::string baselinePath;
+  double tolerance = 0.10;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc)
+    {
+      maxThreads = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--sizes" && i + 1 < argc)
+    {
+      sizes.clear();
+      std::istringstream list(argv[++i]);
+      for (std::string item; std::getline(list, item, ',');)
+      {
+        sizes.push_back(std::max(1, std::atoi(item.c_str())));
+      }
+    }
+    else if (arg == "--json" && i + 1 < argc)
+    {
+      jsonPath = argv[++i];
+    }
+    else if (arg == "--baseline" && i + 1 < argc)
+    {
+      baselinePath = argv[++i];
+    }
+    else if (arg == "--tolerance" && i + 1 < argc)
+    {
+      tolerance = std::atof(argv[++i]);
+    }
+    else if (std::find(kSections.begin(), kSections.end(), arg) != kSections.end())
+    {
+      sections.push_back(arg);
+    }
+    else
+    {
+      std::cerr << "Error: unknown section or option '" << arg << "'" << std::endl;
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  auto selected = [&](const std::string& name)
+  { return sections.empty() || std::find(sections.begin(), sections.end(), name) != sections.end(); };
+
+  bool identical = true;
+  if (selected("fft"))
+  {
+    std::cout << "2D FFT (CV_32FC2, " << simd::isaName(simd::bestIsa()) << ") thread scaling" << std::endl;
+    std::cout << std::setw(6) << "size" << std::setw(9) << "threads" << std::setw(12) << "ms" << std::setw(11)
+              << "speedup" << std::endl;
+    for (int size : {1024, 4096, 8192})
+    {
+      identical = benchmarkFFTScaling(size, maxThreads) && identical;
+    }
+  }
+  if (selected("haar"))
+  {
+    benchmarkHaar();
+  }
+  if (selected("haar-scaling"))
+  {
+    std::cout << "cvHaarWavelet/cvInvHaarWavelet, 3 levels, thread scaling" << std::endl;
+    std::cout << std::setw(6) << "size" << std::setw(9) << "threads" << std::setw(14) << "forward ms" << std::setw(14)
+              << "inverse ms" << std::setw(11) << "speedup" << std::setw(12) << "max diff" << std::endl;
+    for (int size : {4096, 8192, 16384})
+    {
+      identical = benchmarkHaarScaling(size, maxThreads) && identical;
+    }
+  }
+  if (selected("dwt"))
+  {
+    benchmarkDwt();
+  }
+  if (selected("codec"))
+  {
+    benchmarkCodec();
+  }
+  if (selected("dct"))
+  {
+    benchmarkDct();
+  }
+  if (selected("conv"))
+  {
+    benchmarkConvolution();
+  }
+  int regressions = 0;
+  if (selected("suite"))
+  {
+    const int threads = std::min(maxThreads, threading::defaultPool().size());
+    const int openCvThreads = cv::getNumThreads();
+    cv::setNumThreads(threads);
+    std::cout << "Kernel suite (" << simd::isaName(simd::bestIsa()) << ", " << threads << " threads)" << std::endl;
+    std::cout << std::setw(28) << "kernel" << std::setw(6) << "size" << std::setw(12) << "ms" << std::setw(10)
+              << "ns/px" << std::setw(10) << "MPix/s" << std::setw(10) << "allocs" << std::setw(12) << "MiB alloc"
+              << std::endl;
+    std::vector<Measurement> results;
+    for (int size : sizes)
+    {
+      const std::vector<Measurement> sizeResults = runSuite(size, threads);
+      results.insert(results.end(), sizeResults.begin(), sizeResults.end());
+    }
+    cv::setNumThreads(openCvThreads);
+    if (!jsonPath.empty() && !writeJson(jsonPath, results, threads))
+    {
+      std::cerr << "Error: could not write " << jsonPath << std::endl;
+      return 1;
+    }
+    if (!baselinePath.empty())
+    {
+      std::vector<Measurement> baseline;
+      if (!readJson(baselinePath, baseline))
+      {
+        std::cerr << "Error: could not read " << baselinePath << std::endl;
+        return 1;
+      }
+      regressions = compareWithBaseline(results, baseline, tolerance);
+    }
+  }
+
+  if (!identical)
+  {
+    std::cerr << "Error: multithreaded results differ from the single-threaded ones" << std::endl;
+    return 1;
+  }
+  if (regressions > 0)
+  {
+    std::cerr << "Error: " << regressions << " kernel(s) slower than the baseline" << std::endl;
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,371 @@
+/*
+  *block_dct.hpp
+    Block-DCT compression mode for 8-bit gray images: 8x8 DCT,
+    quantization with a JPEG table scaled by a quality factor, and back
+  *The 1D transforms are the AAN (Arai-Agui-Nakajima) factorization used
+   by libjpeg's float DCT (5 multiplications per 8 points); its output
+   scaling is folded into the quantization tables, so quantizing costs one
+   multiply per coefficient.
+  *A block is 8 rows of 8 floats: the column pass runs the butterflies on
+   whole rows at once (one vector per row with AVX2, two with SSE2/NEON),
+   then the block is transposed and the same pass does the rows.
+  *Quantized coefficients are kept as CV_16S in the image layout
+   (coefficient (u, v) of a block at its pixel (u, v)); the image is padded
+   to whole blocks by repeating its last row and column. Block rows are
+   spread over the thread pool.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+namespace dct
+{
+
+const int kBlock = 8;
+const int kBlockArea = kBlock * kBlock;
+
+// Luminance quantization table of the JPEG standard (Annex K), quality 50
+const int kLuminanceTable[kBlockArea] = {16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+                                         14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+                                         18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+                                         49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+
+// Quantization table of one quality, with the AAN output scaling folded in:
+// q = round(aan * forward), aan = q * inverse (before the inverse AAN pass)
+struct QuantTable
+{
+  float forward[kBlockArea];
+  float inverse[kBlockArea];
+};
+
+// Function to build the quantization table of a quality in [1, 100]
+// (libjpeg scaling: 50 = the standard table, 100 = all ones)
+QuantTable quantTable(int quality)
+{
+  quality = std::clamp(quality, 1, 100);
+  const int scale = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+  // AAN scale factors: 1 for k = 0, sqrt(2) cos(k pi / 16) otherwise
+  double aan[kBlock];
+  for (int k = 0; k < kBlock; k++)
+  {
+    aan[k] = k == 0 ? 1.0 : std::sqrt(2.0) * std::cos(k * CV_PI / 16.0);
+  }
+
+  QuantTable table;
+  for (int u = 0; u < kBlock; u++)
+  {
+    for (int v = 0; v < kBlock; v++)
+    {
+      const int i = u * kBlock + v;
+      const int step = std::clamp((kLuminanceTable[i] * scale + 50) / 100, 1, 255);
+      table.forward[i] = static_cast<float>(1.0 / (step * aan[u] * aan[v] * 8.0));
+      // The inverse pass leaves a factor 8, removed here too
+      table.inverse[i] = static_cast<float>(step * aan[u] * aan[v] / 8.0);
+    }
+  }
+  return table;
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+// Forward AAN butterflies on 8 values (each a vector of independent lanes)
+template <typename V>
+SIMD_INLINE void fdct8(V* d)
+{
+  const V tmp0 = d[0] + d[7], tmp7 = d[0] - d[7];
+  const V tmp1 = d[1] + d[6], tmp6 = d[1] - d[6];
+  const V tmp2 = d[2] + d[5], tmp5 = d[2] - d[5];
+  const V tmp3 = d[3] + d[4], tmp4 = d[3] - d[4];
+
+  // Even part
+  const V tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+  const V tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+  d[0] = tmp10 + tmp11;
+  d[4] = tmp10 - tmp11;
+  const V z1 = (tmp12 + tmp13) * 0.707106781f;
+  d[2] = tmp13 + z1;
+  d[6] = tmp13 - z1;
+
+  // Odd part
+  const V odd10 = tmp4 + tmp5, odd11 = tmp5 + tmp6, odd12 = tmp6 + tmp7;
+  const V z5 = (odd10 - odd12) * 0.382683433f;
+  const V z2 = odd10 * 0.541196100f + z5;
+  const V z4 = odd12 * 1.306562965f + z5;
+  const V z3 = odd11 * 0.707106781f;
+  const V z11 = tmp7 + z3, z13 = tmp7 - z3;
+  d[5] = z13 + z2;
+  d[3] = z13 - z2;
+  d[1] = z11 + z4;
+  d[7] = z11 - z4;
+}
+
+// Inverse AAN butterflies (input already multiplied by QuantTable::inverse)
+template <typename V>
+SIMD_INLINE void idct8(V* d)
+{
+  // Even part
+  const V tmp10 = d[0] + d[4], tmp11 = d[0] - d[4];
+  const V tmp13 = d[2] + d[6];
+  const V tmp12 = (d[2] - d[6]) * 1.414213562f - tmp13;
+  const V even0 = tmp10 + tmp13, even3 = tmp10 - tmp13;
+  const V even1 = tmp11 + tmp12, even2 = tmp11 - tmp12;
+
+  // Odd part
+  const V z13 = d[5] + d[3], z10 = d[5] - d[3];
+  const V z11 = d[1] + d[7], z12 = d[1] - d[7];
+  const V tmp7 = z11 + z13;
+  const V odd11 = (z11 - z13) * 1.414213562f;
+  const V z5 = (z10 + z12) * 1.847759065f;
+  const V odd10 = z12 * 1.082392200f - z5;
+  const V odd12 = z10 * -2.613125930f + z5;
+  const V tmp6 = odd12 - tmp7;
+  const V tmp5 = odd11 - tmp6;
+  const V tmp4 = odd10 + tmp5;
+
+  d[0] = even0 + tmp7;
+  d[7] = even0 - tmp7;
+  d[1] = even1 + tmp6;
+  d[6] = even1 - tmp6;
+  d[2] = even2 + tmp5;
+  d[5] = even2 - tmp5;
+  d[4] = even3 + tmp4;
+  d[3] = even3 - tmp4;
+}
+
+SIMD_INLINE void transpose8x8(float* block)
+{
+  for (int i = 0; i < kBlock; i++)
+  {
+    for (int j = i + 1; j < kBlock; j++)
+    {
+      std::swap(block[i * kBlock + j], block[j * kBlock + i]);
+    }
+  }
+}
+
+// Function to run the 1D transform down the 8 columns of a row-major block,
+// lanes<V, float>() columns at a time
+template <typename V, bool Inverse>
+SIMD_INLINE void columnPass(float* block)
+{
+  constexpr int L = simd::lanes<V, float>();
+  for (int c = 0; c < kBlock; c += L)
+  {
+    V d[kBlock];
+    for (int r = 0; r < kBlock; r++)
+    {
+      d[r] = simd::load<V>(block + r * kBlock + c);
+    }
+    if constexpr (Inverse)
+    {
+      idct8(d);
+    }
+    else
+    {
+      fdct8(d);
+    }
+    for (int r = 0; r < kBlock; r++)
+    {
+      simd::store(block + r * kBlock + c, d[r]);
+    }
+  }
+}
+
+// Function to transform a block in place and multiply it by `scale`
+// elementwise: after the 2D DCT when forward, before the 2D IDCT when inverse
+template <typename V, bool Inverse>
+SIMD_INLINE void transformBlock(float* block, const float* scale)
+{
+  constexpr int L = simd::lanes<V, float>();
+  auto applyScale = [&]
+  {
+    for (int i = 0; i < kBlockArea; i += L)
+    {
+      simd::store(block + i, simd::load<V>(block + i) * simd::load<V>(scale + i));
+    }
+  };
+  if constexpr (Inverse)
+  {
+    applyScale();
+  }
+  columnPass<V, Inverse>(block);
+  transpose8x8(block);
+  columnPass<V, Inverse>(block);
+  transpose8x8(block);
+  if constexpr (!Inverse)
+  {
+    applyScale();
+  }
+}
+
+// Per-instruction-set instantiations of transformBlock
+template <bool Inverse>
+void transformBlockScalar(float* block, const float* scale)
+{
+  transformBlock<float, Inverse>(block, scale);
+}
+
+#if defined(SIMD_X86)
+template <bool Inverse>
+SIMD_TARGET("sse2") void transformBlockSse2(float* block, const float* scale)
+{
+  transformBlock<simd::Vector<float, 16>::type, Inverse>(block, scale);
+}
+
+template <bool Inverse>
+SIMD_TARGET("avx2,fma") void transformBlockAvx2(float* block, const float* scale)
+{
+  transformBlock<simd::Vector<float, 32>::type, Inverse>(block, scale);
+}
+#endif
+
+#if defined(SIMD_NEON)
+template <bool Inverse>
+void transformBlockNeon(float* block, const float* scale)
+{
+  transformBlock<simd::Vector<float, 16>::type, Inverse>(block, scale);
+}
+#endif
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+typedef void (*TransformBlockFn)(float*, const float*);
+
+// Best transformBlock kernel of the running CPU, picked once per direction
+template <bool Inverse>
+TransformBlockFn transformBlockKernel()
+{
+  static const TransformBlockFn kernel = []
+  {
+    switch (simd::bestIsa())
+    {
+#if defined(SIMD_X86)
+      case simd::Isa::AVX2:
+        return &transformBlockAvx2<Inverse>;
+      case simd::Isa::SSE2:
+        return &transformBlockSse2<Inverse>;
+#endif
+#if defined(SIMD_NEON)
+      case simd::Isa::NEON:
+        return &transformBlockNeon<Inverse>;
+#endif
+      default:
+        return &transformBlockScalar<Inverse>;
+    }
+  }();
+  return kernel;
+}
+
+// Function to get the size of an image padded to whole blocks
+cv::Size paddedSize(cv::Size size)
+{
+  return cv::Size((size.width + kBlock - 1) / kBlock * kBlock, (size.height + kBlock - 1) / kBlock * kBlock);
+}
+
+// Function to DCT and quantize every 8x8 block of an 8-bit gray image into
+// CV_16S coefficients (padded size). threads: 0 = all cores, 1 = serial.
+void forwardBlocks(const cv::Mat& image, const QuantTable& table, cv::Mat& coefficients, int threads = 0)
+{
+  CV_Assert(image.type() == CV_8UC1);
+  const cv::Size padded = paddedSize(image.size());
+  coefficients.create(padded, CV_16S);
+  const TransformBlockFn transform = transformBlockKernel<false>();
+  threading::defaultPool().parallelFor(
+      padded.height / kBlock,
+      [&](int begin, int end, int)
+      {
+        alignas(32) float block[kBlockArea];
+        for (int by = begin; by < end; by++)
+        {
+          for (int bx = 0; bx < padded.width; bx += kBlock)
+          {
+            // Level shift to [-128, 127]; the padding repeats the last row/column
+            for (int r = 0; r < kBlock; r++)
+            {
+              const uint8_t* row = image.ptr<uint8_t>(std::min(by * kBlock + r, image.rows - 1));
+              for (int c = 0; c < kBlock; c++)
+              {
+                block[r * kBlock + c] = row[std::min(bx + c, image.cols - 1)] - 128.0f;
+              }
+            }
+            transform(block, table.forward);
+            for (int r = 0; r < kBlock; r++)
+            {
+              int16_t* out = coefficients.ptr<int16_t>(by * kBlock + r) + bx;
+              for (int c = 0; c < kBlock; c++)
+              {
+                out[c] = static_cast<int16_t>(std::lrint(block[r * kBlock + c]));
+              }
+            }
+          }
+        }
+      },
+      threads);
+}
+
+// Function to dequantize and inverse DCT forwardBlocks coefficients into an
+// 8-bit image of the given size
+void inverseBlocks(const cv::Mat& coefficients, const QuantTable& table, cv::Size size, cv::Mat& image,
+                   int threads = 0)
+{
+  CV_Assert(coefficients.type() == CV_16SC1 && coefficients.size() == paddedSize(size));
+  image.create(size, CV_8UC1);
+  const TransformBlockFn transform = transformBlockKernel<true>();
+  threading::defaultPool().parallelFor(
+      coefficients.rows / kBlock,
+      [&](int begin, int end, int)
+      {
+        alignas(32) float block[kBlockArea];
+        for (int by = begin; by < end; by++)
+        {
+          for (int bx = 0; bx < coefficients.cols; bx += kBlock)
+          {
+            for (int r = 0; r < kBlock; r++)
+            {
+              const int16_t* in = coefficients.ptr<int16_t>(by * kBlock + r) + bx;
+              for (int c = 0; c < kBlock; c++)
+              {
+                block[r * kBlock + c] = in[c];
+              }
+            }
+            transform(block, table.inverse);
+            const int rows = std::min(kBlock, size.height - by * kBlock);
+            const int cols = std::min(kBlock, size.width - bx);
+            for (int r = 0; r < rows; r++)
+            {
+              uint8_t* out = image.ptr<uint8_t>(by * kBlock + r) + bx;
+              for (int c = 0; c < cols; c++)
+              {
+                out[c] = static_cast<uint8_t>(std::clamp(std::lrint(block[r * kBlock + c] + 128.0f), 0L, 255L));
+              }
+            }
+          }
+        }
+      },
+      threads);
+}
+
+// Function to compress and decompress an image at a quality in [1, 100];
+// returns the reconstruction, `coefficients` receives the quantized blocks
+cv::Mat roundTrip(const cv::Mat& image, int quality, cv::Mat& coefficients, int threads = 0)
+{
+  const QuantTable table = quantTable(quality);
+  forwardBlocks(image, table, coefficients, threads);
+  cv::Mat restored;
+  inverseBlocks(coefficients, table, image.size(), restored, threads);
+  return restored;
+}
+
+} // namespace dct
@@ -0,0 +1,690 @@
+/*
+  *codec.hpp
+    Lossy wavelet codec for 8-bit gray images (.imsw files)
+  *Encoder: level shift by -128, multi-level lifting DWT (dwt.hpp, CDF 9/7 by
+   default), dead-zone uniform quantization with one step for all bands,
+   then context-adaptive binary range coding of the quantized coefficients.
+  *Coefficients are coded band by band, coarsest first. For each one a
+   "significant" bit is coded in a context made of its band class, how many
+   of its already coded neighbours are significant and whether its parent
+   (same position, next coarser band) is; significant ones add an
+   Elias-gamma magnitude (adaptive prefix, raw suffix) and a raw sign bit.
+  *Rate control: a fixed quantization step, or the step is searched
+   (bisection on its logarithm) so that the file fits a target bitrate or
+   the decoded image reaches a target PSNR (an error if even the coarsest
+   or finest step of the search misses it). Each search step is one
+   quantize + code (bitrate) or quantize + inverse DWT (PSNR) pass; the DWT
+   itself is done once.
+  *Container (little endian, 24 bytes + payload):
+     "IMSW" | version u8 | family u8 | levels u8 | 0 u8 | width u32 | height u32 | step f32 | payload bytes u32
+  *Usage:
+     IMS --encode <image> <file.imsw> [--bpp X | --psnr dB | --step Q] [--wavelet cdf53|cdf97|d4|d8] [--levels N]
+     IMS --decode <file.imsw> <image>
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <string>
+#include <vector>
+
+#include "dwt.hpp"
+#include "metrics.hpp"
+
+namespace codec
+{
+
+const char kMagic[4] = {'I', 'M', 'S', 'W'};
+const int kVersion = 1;
+const int kHeaderBytes = 24;
+// Most DWT levels a file may use
+const int kMaxLevels = 16;
+// Upper bound on the coefficients one payload byte can hold: every
+// coefficient codes at least one adaptive bit, which costs at least
+// -log2(2017 / 2048) = 0.022 bits as probabilities stop adapting 31 / 2048
+// short of certainty (0.02 leaves some slack)
+const double kMaxCoefficientsPerByte = 8.0 / 0.02;
+// Dequantized magnitude = (|q| + kReconstructionOffset) * step: slightly
+// below the middle of the bin, as detail coefficients are peaked at zero
+const float kReconstructionOffset = 0.4f;
+
+// Adaptive binary range coder (LZMA style): 11-bit probabilities of a 0
+// bit, adapted by 1/32 of the error after every bit
+const int kProbabilityBits = 11;
+const uint16_t kProbabilityInit = 1 << (kProbabilityBits - 1);
+const int kAdaptShift = 5;
+const uint32_t kRangeTop = 1u << 24;
+
+class RangeEncoder
+{
+public:
+  void encode(uint16_t& probability, int bit)
+  {
+    const uint32_t bound = (range_ >> kProbabilityBits) * probability;
+    if (bit)
+    {
+      low_ += bound;
+      range_ -= bound;
+      probability -= probability >> kAdaptShift;
+    }
+    else
+    {
+      range_ = bound;
+      probability += ((1 << kProbabilityBits) - probability) >> kAdaptShift;
+    }
+    normalize();
+  }
+
+  // Bits with probability 1/2, most significant first
+  void encodeDirect(uint32_t value, int bits)
+  {
+    for (int i = bits - 1; i >= 0; i--)
+    {
+      range_ >>= 1;
+      if ((value >> i) & 1)
+      {
+        low_ += range_;
+      }
+      normalize();
+    }
+  }
+
+  std::vector<uint8_t> finish()
+  {
+    for (int i = 0; i < 5; i++)
+    {
+      shiftLow();
+    }
+    return std::move(bytes_);
+  }
+
+private:
+  void normalize()
+  {
+    while (range_ < kRangeTop)
+    {
+      range_ <<= 8;
+      shiftLow();
+    }
+  }
+
+  // Outputs the top byte of low, resolving carries into the pending 0xFF bytes
+  void shiftLow()
+  {
+    if (static_cast<uint32_t>(low_) < 0xFF000000u || (low_ >> 32) != 0)
+    {
+      const uint8_t carry = static_cast<uint8_t>(low_ >> 32);
+      uint8_t byte = cache_;
+      do
+      {
+        bytes_.push_back(static_cast<uint8_t>(byte + carry));
+        byte = 0xFF;
+      } while (--pending_ != 0);
+      cache_ = static_cast<uint8_t>(low_ >> 24);
+    }
+    pending_++;
+    low_ = (low_ & 0x00FFFFFFu) << 8;
+  }
+
+  uint64_t low_ = 0;
+  uint32_t range_ = 0xFFFFFFFFu;
+  uint8_t cache_ = 0;
+  uint64_t pending_ = 1;
+  std::vector<uint8_t> bytes_;
+};
+
+class RangeDecoder
+{
+public:
+  RangeDecoder(const uint8_t* data, std::size_t size) : data_(data), size_(size)
+  {
+    for (int i = 0; i < 5; i++)
+    {
+      code_ = (code_ << 8) | next();
+    }
+  }
+
+  int decode(uint16_t& probability)
+  {
+    const uint32_t bound = (range_ >> kProbabilityBits) * probability;
+    int bit;
+    if (code_ < bound)
+    {
+      range_ = bound;
+      probability += ((1 << kProbabilityBits) - probability) >> kAdaptShift;
+      bit = 0;
+    }
+    else
+    {
+      code_ -= bound;
+      range_ -= bound;
+      probability -= probability >> kAdaptShift;
+      bit = 1;
+    }
+    normalize();
+    return bit;
+  }
+
+  uint32_t decodeDirect(int bits)
+  {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; i++)
+    {
+      range_ >>= 1;
+      const uint32_t bit = code_ >= range_;
+      code_ -= range_ & (0u - bit);
+      value = (value << 1) | bit;
+      normalize();
+    }
+    return value;
+  }
+
+  // True if the decoder read past the end of its data (corrupt stream)
+  bool overrun() const { return position_ > size_ + 4; }
+
+private:
+  uint8_t next()
+  {
+    const std::size_t i = position_++;
+    return i < size_ ? data_[i] : 0;
+  }
+
+  void normalize()
+  {
+    while (range_ < kRangeTop)
+    {
+      range_ <<= 8;
+      code_ = (code_ << 8) | next();
+    }
+  }
+
+  const uint8_t* data_;
+  std::size_t size_;
+  std::size_t position_ = 0;
+  uint32_t code_ = 0;
+  uint32_t range_ = 0xFFFFFFFFu;
+};
+
+// One subband of the coefficient layout, with its parent band (same
+// orientation, next coarser level) if it has one
+struct Band
+{
+  cv::Rect rect;
+  cv::Rect parent;
+  int bandClass; // 0 = LL, 1 = coarse details, 2 = finest details
+};
+
+// Function to list the bands of a dwtForward layout in coding order (LL,
+// then HL, LH, HH from the coarsest level to the finest)
+std::vector<Band> bandLayout(cv::Size size, int levels)
+{
+  const std::vector<cv::Size> sizes = wavelets::dwtLevelSizes(size, levels);
+  std::vector<Band> bands;
+  if (sizes.empty())
+  {
+    bands.push_back({cv::Rect(0, 0, size.width, size.height), cv::Rect(), 0});
+    return bands;
+  }
+
+  auto orientations = [](cv::Size level)
+  {
+    const int lw = (level.width + 1) / 2;
+    const int lh = (level.height + 1) / 2;
+    return std::vector<cv::Rect>{cv::Rect(lw, 0, level.width - lw, lh), cv::Rect(0, lh, lw, level.height - lh),
+                                 cv::Rect(lw, lh, level.width - lw, level.height - lh)};
+  };
+  const cv::Size ll((sizes.back().width + 1) / 2, (sizes.back().height + 1) / 2);
+  bands.push_back({cv::Rect(0, 0, ll.width, ll.height), cv::Rect(), 0});
+  for (int k = static_cast<int>(sizes.size()) - 1; k >= 0; k--)
+  {
+    const std::vector<cv::Rect> rects = orientations(sizes[k]);
+    for (int o = 0; o < 3; o++)
+    {
+      const cv::Rect parent = k + 1 < static_cast<int>(sizes.size()) ? orientations(sizes[k + 1])[o] : cv::Rect();
+      bands.push_back({rects[o], parent, k == 0 ? 2 : 1});
+    }
+  }
+  return bands;
+}
+
+// Adaptive probabilities of the coefficient coder
+struct Contexts
+{
+  static const int kPrefixLength = 20;
+  uint16_t significant[3][5][2];
+  uint16_t prefix[3][4][kPrefixLength];
+
+  Contexts()
+  {
+    std::fill_n(&significant[0][0][0], sizeof(significant) / sizeof(uint16_t), kProbabilityInit);
+    std::fill_n(&prefix[0][0][0], sizeof(prefix) / sizeof(uint16_t), kProbabilityInit);
+  }
+};
+
+// Context inputs of coefficient (y, x) of a band, from the already coded
+// coefficients of q: significant neighbours (left, up-left, up, up-right),
+// the magnitude class of left + up and the significance of the parent
+struct Neighbourhood
+{
+  int significant;
+  int magnitude;
+  int parent;
+};
+
+inline Neighbourhood neighbourhood(const cv::Mat& q, const Band& band, int y, int x)
+{
+  const cv::Rect& r = band.rect;
+  const int* row = q.ptr<int>(y);
+  const int left = x > r.x ? std::abs(row[x - 1]) : 0;
+  int up = 0;
+  int significant = left != 0;
+  if (y > r.y)
+  {
+    const int* above = q.ptr<int>(y - 1);
+    up = std::abs(above[x]);
+    significant += (up != 0) + (x > r.x && above[x - 1] != 0) + (x + 1 < r.x + r.width && above[x + 1] != 0);
+  }
+  const int sum = left + up;
+  const int magnitude = sum == 0 ? 0 : sum <= 2 ? 1 : sum <= 8 ? 2 : 3;
+  int parent = 0;
+  if (band.parent.area() > 0)
+  {
+    const int py = band.parent.y + std::min((y - r.y) / 2, band.parent.height - 1);
+    const int px = band.parent.x + std::min((x - r.x) / 2, band.parent.width - 1);
+    parent = q.ptr<int>(py)[px] != 0;
+  }
+  return {significant, magnitude, parent};
+}
+
+// Function to range code quantized coefficients (CV_32S, dwtForward layout)
+std::vector<uint8_t> encodeCoefficients(const cv::Mat& q, int levels)
+{
+  RangeEncoder encoder;
+  Contexts contexts;
+  for (const Band& band : bandLayout(q.size(), levels))
+  {
+    for (int y = band.rect.y; y < band.rect.y + band.rect.height; y++)
+    {
+      const int* row = q.ptr<int>(y);
+      for (int x = band.rect.x; x < band.rect.x + band.rect.width; x++)
+      {
+        const Neighbourhood n = neighbourhood(q, band, y, x);
+        const int value = row[x];
+        encoder.encode(contexts.significant[band.bandClass][n.significant][n.parent], value != 0);
+        if (value == 0)
+        {
+          continue;
+        }
+        // Elias gamma: k = floor(log2 |value|) in unary, then the k bits below the top one
+        const uint32_t magnitude = std::abs(value);
+        const int k = 31 - __builtin_clz(magnitude);
+        uint16_t* prefix = contexts.prefix[band.bandClass][n.magnitude];
+        for (int i = 0; i < k; i++)
+        {
+          encoder.encode(prefix[std::min(i, Contexts::kPrefixLength - 1)], 1);
+        }
+        encoder.encode(prefix[std::min(k, Contexts::kPrefixLength - 1)], 0);
+        encoder.encodeDirect(magnitude, k);
+        encoder.encodeDirect(value < 0, 1);
+      }
+    }
+  }
+  return encoder.finish();
+}
+
+// Function to decode what encodeCoefficients wrote into q (size set by the
+// caller); false if the stream is corrupt
+bool decodeCoefficients(const uint8_t* data, std::size_t size, int levels, cv::Mat& q)
+{
+  RangeDecoder decoder(data, size);
+  Contexts contexts;
+  q.setTo(0);
+  for (const Band& band : bandLayout(q.size(), levels))
+  {
+    for (int y = band.rect.y; y < band.rect.y + band.rect.height; y++)
+    {
+      int* row = q.ptr<int>(y);
+      for (int x = band.rect.x; x < band.rect.x + band.rect.width; x++)
+      {
+        const Neighbourhood n = neighbourhood(q, band, y, x);
+        if (!decoder.decode(contexts.significant[band.bandClass][n.significant][n.parent]))
+        {
+          continue;
+        }
+        uint16_t* prefix = contexts.prefix[band.bandClass][n.magnitude];
+        int k = 0;
+        while (decoder.decode(prefix[std::min(k, Contexts::kPrefixLength - 1)]))
+        {
+          if (++k > 30)
+          {
+            return false;
+          }
+        }
+        const uint32_t magnitude = (1u << k) | decoder.decodeDirect(k);
+        row[x] = decoder.decodeDirect(1) ? -static_cast<int>(magnitude) : static_cast<int>(magnitude);
+      }
+    }
+    if (decoder.overrun())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Function to quantize coefficients with a dead-zone quantizer: q = sign(c) floor(|c| / step)
+void quantize(const cv::Mat& coefficients, float step, cv::Mat& q)
+{
+  q.create(coefficients.size(), CV_32S);
+  const float inverse = 1.0f / step;
+  for (int y = 0; y < coefficients.rows; y++)
+  {
+    const float* c = coefficients.ptr<float>(y);
+    int* out = q.ptr<int>(y);
+    for (int x = 0; x < coefficients.cols; x++)
+    {
+      const int magnitude = static_cast<int>(std::min(std::fabs(c[x]) * inverse, 1e9f));
+      out[x] = c[x] < 0 ? -magnitude : magnitude;
+    }
+  }
+}
+
+void dequantize(const cv::Mat& q, float step, cv::Mat& coefficients)
+{
+  coefficients.create(q.size(), CV_32F);
+  for (int y = 0; y < q.rows; y++)
+  {
+    const int* in = q.ptr<int>(y);
+    float* c = coefficients.ptr<float>(y);
+    for (int x = 0; x < q.cols; x++)
+    {
+      const float magnitude = in[x] ? (std::abs(in[x]) + kReconstructionOffset) * step : 0.0f;
+      c[x] = in[x] < 0 ? -magnitude : magnitude;
+    }
+  }
+}
+
+// Function to turn dequantized coefficients back into an 8-bit image (consumes coefficients)
+cv::Mat reconstruct(cv::Mat& coefficients, wavelets::Family family, int levels)
+{
+  wavelets::dwtInverse(coefficients, family, levels);
+  cv::Mat image;
+  coefficients.convertTo(image, CV_8U, 1.0, 128.0);
+  return image;
+}
+
+struct Options
+{
+  wavelets::Family family = wavelets::Family::CDF97;
+  int levels = 5;
+  float step = 8.0f;       // Quantization step, used when there is no target
+  double targetBpp = 0.0;  // Bits per pixel (whole file), 0 = none
+  double targetPsnr = 0.0; // dB, 0 = none
+};
+
+void appendU32(std::vector<uint8_t>& out, uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+uint32_t readU32(const uint8_t* in) { return in[0] | in[1] << 8 | in[2] << 16 | static_cast<uint32_t>(in[3]) << 24; }
+
+// Function to write the container around a coded payload
+std::vector<uint8_t> writeContainer(cv::Size size, const Options& options, float step,
+                                    const std::vector<uint8_t>& payload)
+{
+  std::vector<uint8_t> out(kMagic, kMagic + 4);
+  out.push_back(kVersion);
+  out.push_back(static_cast<uint8_t>(options.family));
+  // The levels the DWT really does, so the decoder can check them
+  out.push_back(static_cast<uint8_t>(wavelets::dwtLevelSizes(size, options.levels).size()));
+  out.push_back(0);
+  appendU32(out, size.width);
+  appendU32(out, size.height);
+  uint32_t stepBits;
+  std::memcpy(&stepBits, &step, 4);
+  appendU32(out, stepBits);
+  appendU32(out, static_cast<uint32_t>(payload.size()));
+  out.insert(out.end(), payload.begin(), payload.end());
+  return out;
+}
+
+// Function to encode an 8-bit gray image into an .imsw byte stream; step is
+// set to the quantization step used. False (after printing why, and what the
+// bounds of the search reach) if a bitrate or PSNR target cannot be met.
+bool encode(const cv::Mat& image, const Options& options, std::vector<uint8_t>& data, float& step)
+{
+  CV_Assert(image.type() == CV_8UC1);
+  cv::Mat coefficients;
+  image.convertTo(coefficients, CV_32F, 1.0, -128.0);
+  wavelets::dwtForward(coefficients, options.family, options.levels);
+
+  cv::Mat q;
+  auto coded = [&](float step)
+  {
+    quantize(coefficients, step, q);
+    return encodeCoefficients(q, options.levels);
+  };
+  auto decodedPsnr = [&](float step)
+  {
+    cv::Mat restored;
+    quantize(coefficients, step, q);
+    dequantize(q, step, restored);
+    return metrics::psnr(image, reconstruct(restored, options.family, options.levels));
+  };
+
+  step = options.step;
+  if (options.targetBpp > 0.0 || options.targetPsnr > 0.0)
+  {
+    // Size and PSNR both decrease as the step grows: a bitrate target wants
+    // the smallest step that fits, a PSNR target the largest one that reaches
+    // it. Bisection on log2(step); `passing` always meets the target.
+    const double budget = options.targetBpp * image.total() / 8.0 - kHeaderBytes;
+    const bool bitrate = options.targetBpp > 0.0;
+    auto meets = [&](float candidate)
+    { return bitrate ? coded(candidate).size() <= budget : decodedPsnr(candidate) >= options.targetPsnr; };
+    double passing = std::log2(bitrate ? 4096.0 : 0.05);
+    double failing = std::log2(bitrate ? 0.05 : 4096.0);
+    const float bound = static_cast<float>(std::exp2(passing));
+    if (!meets(bound))
+    {
+      if (bitrate)
+      {
+        std::cerr << "Error: " << options.targetBpp << " bpp cannot be reached, the smallest file (step " << bound
+                  << ") takes " << (coded(bound).size() + kHeaderBytes) * 8.0 / image.total() << " bpp" << std::endl;
+      }
+      else
+      {
+        std::cerr << "Error: " << options.targetPsnr << " dB cannot be reached, the finest step (" << bound
+                  << ") gives " << decodedPsnr(bound) << " dB" << std::endl;
+      }
+      return false;
+    }
+    for (int i = 0; i < 16; i++)
+    {
+      const double middle = 0.5 * (passing + failing);
+      (meets(static_cast<float>(std::exp2(middle))) ? passing : failing) = middle;
+    }
+    step = static_cast<float>(std::exp2(passing));
+  }
+  data = writeContainer(image.size(), options, step, coded(step));
+  return true;
+}
+
+// Function to decode an .imsw byte stream; false (after printing why) if it is invalid
+bool decode(const std::vector<uint8_t>& data, cv::Mat& image)
+{
+  if (data.size() < static_cast<std::size_t>(kHeaderBytes) || !std::equal(kMagic, kMagic + 4, data.begin()) ||
+      data[4] != kVersion || data[5] > static_cast<int>(wavelets::Family::Daubechies8))
+  {
+    std::cerr << "Error: not an IMSW version " << kVersion << " file" << std::endl;
+    return false;
+  }
+  const wavelets::Family family = static_cast<wavelets::Family>(data[5]);
+  const int levels = data[6];
+  const uint32_t width = readU32(&data[8]);
+  const uint32_t height = readU32(&data[12]);
+  const uint32_t stepBits = readU32(&data[16]);
+  const uint32_t payload = readU32(&data[20]);
+  float step;
+  std::memcpy(&step, &stepBits, 4);
+  // The size must be codable in the payload (plus the bytes the range coder
+  // flushes) before anything of that size is allocated
+  const double coefficients = static_cast<double>(width) * height;
+  if (width == 0 || height == 0 || width > 1u << 16 || height > 1u << 16 || !(step > 0.0f) ||
+      payload > data.size() - kHeaderBytes || coefficients > (payload + 5.0) * kMaxCoefficientsPerByte ||
+      levels > kMaxLevels ||
+      static_cast<int>(wavelets::dwtLevelSizes(cv::Size(width, height), levels).size()) != levels)
+  {
+    std::cerr << "Error: corrupt IMSW header" << std::endl;
+    return false;
+  }
+
+  cv::Mat q(height, width, CV_32S);
+  if (!decodeCoefficients(data.data() + kHeaderBytes, payload, levels, q))
+  {
+    std::cerr << "Error: corrupt IMSW payload" << std::endl;
+    return false;
+  }
+  cv::Mat dequantized;
+  dequantize(q, step, dequantized);
+  image = reconstruct(dequantized, family, levels);
+  return true;
+}
+
+bool writeFile(const std::string& path, const std::vector<uint8_t>& data)
+{
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(data.data()), data.size());
+  return static_cast<bool>(file);
+}
+
+bool readFile(const std::string& path, std::vector<uint8_t>& data)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+  {
+    return false;
+  }
+  data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program
+            << " --encode <image> <file.imsw> [--bpp X | --psnr dB | --step Q] [--wavelet cdf53|cdf97|d4|d8]"
+               " [--levels N]\n"
+            << "       " << program << " --decode <file.imsw> <image>\n";
+}
+
+// Entry point of the codec mode; returns the process exit code
+int main(int argc, char** argv)
+{
+  if (argc < 4 || (std::string(argv[1]) != "--encode" && std::string(argv[1]) != "--decode"))
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+  const bool encoding = std::string(argv[1]) == "--encode";
+  const std::string input = argv[2];
+  const std::string output = argv[3];
+
+  Options options;
+  for (int i = 4; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc || !encoding)
+    {
+      std::cerr << "Error: unexpected option " << arg << std::endl;
+      printUsage(argv[0]);
+      return 1;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--bpp")
+    {
+      options.targetBpp = std::atof(value.c_str());
+    }
+    else if (arg == "--psnr")
+    {
+      options.targetPsnr = std::atof(value.c_str());
+    }
+    else if (arg == "--step" && std::atof(value.c_str()) > 0.0)
+    {
+      options.step = static_cast<float>(std::atof(value.c_str()));
+    }
+    else if (arg == "--levels")
+    {
+      options.levels = std::clamp(std::atoi(value.c_str()), 0, kMaxLevels);
+    }
+    else if (arg != "--wavelet" || !wavelets::parseFamily(value, options.family))
+    {
+      std::cerr << "Error: invalid option " << arg << " " << value << std::endl;
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  cv::Mat image;
+  std::vector<uint8_t> data;
+  float step = 0.0f;
+  if (encoding)
+  {
+    image = cv::imread(input, cv::IMREAD_GRAYSCALE);
+    if (image.empty())
+    {
+      std::cerr << "Error: could not read " << input << std::endl;
+      return 1;
+    }
+    if (!encode(image, options, data, step))
+    {
+      return 1;
+    }
+    if (!writeFile(output, data))
+    {
+      std::cerr << "Error: could not write " << output << std::endl;
+      return 1;
+    }
+  }
+  else
+  {
+    if (!readFile(input, data) || !decode(data, image))
+    {
+      std::cerr << "Error: could not decode " << input << std::endl;
+      return 1;
+    }
+    if (!cv::imwrite(output, image))
+    {
+      std::cerr << "Error: could not write " << output << std::endl;
+      return 1;
+    }
+  }
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << std::fixed << std::setprecision(3) << (encoding ? "Encoded " : "Decoded ") << image.cols << "x"
+            << image.rows << ": " << data.size() << " bytes, " << data.size() * 8.0 / image.total() << " bpp, "
+            << ms << " ms";
+  if (encoding)
+  {
+    std::cout << ", step " << step;
+  }
+  std::cout << std::endl;
+  return 0;
+}
+
+} // namespace codec
@@ -0,0 +1,466 @@
+/*
+  *convolution.hpp
+    Spatial filtering with a kernel (the result of cv::filter2D: correlation,
+    anchor at the kernel center, output of the input depth; up to float
+    rounding, so 8-bit outputs of the separable and FFT routes may differ
+    from cv::filter2D by one level) through the cheapest of three routes:
+  *direct: cv::filter2D (which itself switches to a DFT for kernels of
+   kOpenCvDftArea coefficients and more),
+  *separable: cv::sepFilter2D with the two factors of a rank-1 kernel (found
+   by SVD: box, Gaussian, identity and other outer-product kernels),
+  *FFT: overlap-save on square tiles, one forward and one inverse real FFT
+   per tile against the tile spectrum of the kernel; the spectra (and their
+   FFT plans) are kept in a bounded cache for reuse.
+  *The route is picked from a cost model whose per-operation times are
+   measured once per process on the running machine (a few tens of ms, on
+   the first call that needs them).
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <tuple>
+#include <vector>
+
+#include "FFT.hpp"
+#include "thread_pool.hpp"
+
+namespace convolution
+{
+
+// Singular value ratio below which a kernel counts as rank 1
+const double kRankOneTolerance = 1e-6;
+// Smallest FFT tile side
+const int kMinTile = 32;
+// Kernel area from which cv::filter2D may use its own DFT instead of
+// direct taps (50, or 130 for 8U/32F with SSE3)
+const int kOpenCvDftArea = 50;
+
+enum class Method
+{
+  Auto,
+  Direct,
+  Separable,
+  Fft
+};
+
+const char* methodName(Method method)
+{
+  switch (method)
+  {
+    case Method::Direct:
+      return "direct";
+    case Method::Separable:
+      return "separable";
+    case Method::Fft:
+      return "FFT";
+    default:
+      return "auto";
+  }
+}
+
+// Measured cost of each route, in ns per unit of work
+struct CostModel
+{
+  double directPerTap = 0.0;      // Per output pixel and kernel coefficient
+  double directDftPerPoint = 0.0; // Large kernels (cv::filter2D's DFT), per output pixel and directDftLog
+  double separablePerTap = 0.0;   // Per output pixel and coefficient of the two 1D kernels
+  double fftPerPoint = 0.0;       // Per point of L^2 log2(L^2) for an L x L tile
+};
+
+// Route picked for an image size and kernel
+struct Choice
+{
+  Method method = Method::Direct;
+  int tile = 0;        // FFT tile side
+  double costMs = 0.0; // Estimated time
+  cv::Mat kernelX;     // Separable factors (1 x cols and rows x 1)
+  cv::Mat kernelY;
+};
+
+// Function to split a kernel into kernelY * kernelX (column times row);
+// false if it is not rank 1
+bool separate(const cv::Mat& kernel, cv::Mat& kernelX, cv::Mat& kernelY)
+{
+  cv::Mat k;
+  kernel.convertTo(k, CV_64F);
+  if (k.rows == 1 || k.cols == 1)
+  {
+    kernelX = k.rows == 1 ? k : cv::Mat::ones(1, 1, CV_64F);
+    kernelY = k.rows == 1 ? cv::Mat::ones(1, 1, CV_64F) : k;
+    return true;
+  }
+  cv::Mat w, u, vt;
+  cv::SVD::compute(k, w, u, vt);
+  const double first = w.at<double>(0);
+  if (first == 0.0 || w.at<double>(1) > kRankOneTolerance * first)
+  {
+    return false;
+  }
+  kernelX = vt.row(0) * std::sqrt(first);
+  kernelY = u.col(0) * std::sqrt(first);
+  return true;
+}
+
+// Tile spectrum of a (CV_32F) kernel and the FFT plan of the tile size
+struct KernelSpectrum
+{
+  KernelSpectrum(const cv::Mat& kernel, int tile) : plan(tile, tile)
+  {
+    CV_Assert(kernel.type() == CV_32FC1);
+    cv::Mat padded(tile, tile, CV_32F, cv::Scalar(0));
+    kernel.copyTo(padded(cv::Rect(0, 0, kernel.cols, kernel.rows)));
+    plan.forward(padded, spectrum, 0);
+    // Correlation multiplies by the conjugate
+    for (int u = 0; u < spectrum.rows; u++)
+    {
+      cv::Vec2f* s = spectrum.ptr<cv::Vec2f>(u);
+      for (int v = 0; v < spectrum.cols; v++)
+      {
+        s[v][1] = -s[v][1];
+      }
+    }
+  }
+
+  FFT::RealPlan2d<float> plan;
+  cv::Mat spectrum; // tile x (tile/2 + 1), CV_32FC2, conjugated
+};
+
+// Bounded LRU cache of kernel spectra, keyed by tile size and kernel
+// coefficients; spectra are handed out as shared read-only matrices
+class SpectrumCache
+{
+public:
+  explicit SpectrumCache(std::size_t maxBytes) : maxBytes_(maxBytes) {}
+
+  SpectrumCache(const SpectrumCache&) = delete;
+  SpectrumCache& operator=(const SpectrumCache&) = delete;
+
+  std::shared_ptr<const KernelSpectrum> get(const cv::Mat& kernel, int tile)
+  {
+    Key key(tile, kernel.rows, kernel.cols, std::vector<float>());
+    cv::Mat k;
+    kernel.convertTo(k, CV_32F);
+    for (int y = 0; y < k.rows; y++)
+    {
+      std::get<3>(key).insert(std::get<3>(key).end(), k.ptr<float>(y), k.ptr<float>(y) + k.cols);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = index_.find(key);
+      if (found != index_.end())
+      {
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, found->second);
+        return found->second->spectrum;
+      }
+      ++misses_;
+    }
+
+    auto spectrum = std::make_shared<const KernelSpectrum>(k, tile);
+    const std::size_t bytes = spectrum->spectrum.total() * spectrum->spectrum.elemSize();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (bytes > maxBytes_ || index_.count(key))
+    {
+      return spectrum;
+    }
+    entries_.push_front(Entry{key, spectrum, bytes});
+    index_[key] = entries_.begin();
+    bytes_ += bytes;
+    while (bytes_ > maxBytes_)
+    {
+      bytes_ -= entries_.back().bytes;
+      index_.erase(entries_.back().key);
+      entries_.pop_back();
+    }
+    return spectrum;
+  }
+
+  std::size_t hits() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+  }
+
+  std::size_t misses() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+  }
+
+private:
+  typedef std::tuple<int, int, int, std::vector<float>> Key;
+
+  struct Entry
+  {
+    Key key;
+    std::shared_ptr<const KernelSpectrum> spectrum;
+    std::size_t bytes;
+  };
+
+  std::size_t maxBytes_;
+  std::size_t bytes_ = 0;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+  std::list<Entry> entries_; // Most recently used first
+  std::map<Key, std::list<Entry>::iterator> index_;
+  mutable std::mutex mutex_;
+};
+
+// Process-wide cache of kernel spectra (64 MiB)
+SpectrumCache& spectrumCache()
+{
+  static SpectrumCache cache(64u << 20);
+  return cache;
+}
+
+// Function to correlate a CV_32FC1 image with a kernel by FFT on tile x tile
+// blocks; the image is extended by borderType like cv::filter2D does
+void correlateFft(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel, int borderType, int tile, int threads)
+{
+  CV_Assert(src.type() == CV_32FC1 && tile >= kernel.rows && tile >= kernel.cols);
+  const int ax = kernel.cols / 2;
+  const int ay = kernel.rows / 2;
+  cv::Mat padded;
+  cv::copyMakeBorder(src, padded, ay, kernel.rows - 1 - ay, ax, kernel.cols - 1 - ax, borderType);
+  const std::shared_ptr<const KernelSpectrum> K = spectrumCache().get(kernel, tile);
+
+  // Each tile gives the block of outputs whose kernel footprint lies inside it
+  const int blockW = tile - kernel.cols + 1;
+  const int blockH = tile - kernel.rows + 1;
+  const int tilesX = (src.cols + blockW - 1) / blockW;
+  const int tilesY = (src.rows + blockH - 1) / blockH;
+  const int tiles = tilesX * tilesY;
+  threading::ThreadPool& pool = threading::defaultPool();
+  threads = threads > 0 ? std::min(threads, pool.size()) : pool.size();
+  const int tileThreads = tiles >= threads ? 1 : threads;
+
+  dst.create(src.size(), CV_32F);
+  pool.parallelFor(
+      tiles,
+      [&](int begin, int end, int)
+      {
+        cv::Mat data(tile, tile, CV_32F), spectrum;
+        for (int t = begin; t < end; t++)
+        {
+          const int y0 = (t / tilesX) * blockH;
+          const int x0 = (t % tilesX) * blockW;
+          const int h = std::min(tile, padded.rows - y0);
+          const int w = std::min(tile, padded.cols - x0);
+          data.setTo(cv::Scalar(0));
+          padded(cv::Rect(x0, y0, w, h)).copyTo(data(cv::Rect(0, 0, w, h)));
+
+          K->plan.forward(data, spectrum, tileThreads);
+          for (int u = 0; u < spectrum.rows; u++)
+          {
+            cv::Vec2f* s = spectrum.ptr<cv::Vec2f>(u);
+            const cv::Vec2f* k = K->spectrum.ptr<cv::Vec2f>(u);
+            for (int v = 0; v < spectrum.cols; v++)
+            {
+              const float re = s[v][0] * k[v][0] - s[v][1] * k[v][1];
+              const float im = s[v][0] * k[v][1] + s[v][1] * k[v][0];
+              s[v] = cv::Vec2f(re, im);
+            }
+          }
+          K->plan.inverse(spectrum, data, tileThreads);
+
+          const int outH = std::min(blockH, src.rows - y0);
+          const int outW = std::min(blockW, src.cols - x0);
+          data(cv::Rect(0, 0, outW, outH)).copyTo(dst(cv::Rect(x0, y0, outW, outH)));
+        }
+      },
+      tileThreads == 1 ? threads : 1);
+}
+
+// Function to get the best time of a few runs of fn, in ns
+template <typename F>
+double bestTimeNs(F&& fn)
+{
+  double best = 1e300;
+  for (int r = 0; r < 3; r++)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+// Function to get the log2 size of the DFT cv::filter2D uses for a kernel
+double directDftLog(cv::Size kernel)
+{
+  return std::log2(4.0 * kernel.width * kernel.height);
+}
+
+// Function to measure the cost model on this machine (512 x 512 image)
+CostModel calibrate()
+{
+  const int n = 512;
+  cv::Mat image(n, n, CV_32F), out;
+  cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+  const double pixels = static_cast<double>(n) * n;
+  CostModel model;
+
+  // Small enough for the direct path of cv::filter2D
+  const cv::Mat direct = cv::Mat::ones(5, 5, CV_32F) / 25.0;
+  model.directPerTap = bestTimeNs([&] { cv::filter2D(image, out, -1, direct); }) / (pixels * 25);
+
+  // Large enough for cv::filter2D to switch to its DFT, whose cost barely
+  // grows with the kernel
+  const cv::Mat large = cv::Mat::ones(41, 41, CV_32F) / (41.0 * 41.0);
+  model.directDftPerPoint =
+      bestTimeNs([&] { cv::filter2D(image, out, -1, large); }) / (pixels * directDftLog(large.size()));
+
+  const cv::Mat line = cv::Mat::ones(1, 15, CV_32F) / 15.0;
+  model.separablePerTap = bestTimeNs([&] { cv::sepFilter2D(image, out, -1, line, line.t()); }) / (pixels * 30);
+
+  const int tile = 128;
+  const cv::Mat fftKernel = cv::Mat::ones(9, 9, CV_32F) / 81.0;
+  correlateFft(image, out, fftKernel, cv::BORDER_DEFAULT, tile, 0); // Builds the spectrum outside the timing
+  const int tiles = static_cast<int>(std::pow(std::ceil(n / (tile - 8.0)), 2));
+  const double points = tiles * static_cast<double>(tile) * tile * std::log2(static_cast<double>(tile) * tile);
+  model.fftPerPoint =
+      bestTimeNs([&] { correlateFft(image, out, fftKernel, cv::BORDER_DEFAULT, tile, 0); }) / points;
+  return model;
+}
+
+// The cost model of the running machine, measured on first use
+const CostModel& costModel()
+{
+  static const CostModel model = calibrate();
+  return model;
+}
+
+// Function to estimate cv::filter2D on an image of `pixels` pixels: direct
+// taps, or at most its DFT route once the kernel is large enough for it
+double directCost(double pixels, cv::Size kernel)
+{
+  const CostModel& model = costModel();
+  const double area = static_cast<double>(kernel.width) * kernel.height;
+  double cost = pixels * area * model.directPerTap;
+  if (area >= kOpenCvDftArea)
+  {
+    cost = std::min(cost, pixels * directDftLog(kernel) * model.directDftPerPoint);
+  }
+  return cost;
+}
+
+// Function to estimate the FFT route for an image size and kernel size;
+// returns the tile side with the lowest cost and sets costNs
+int bestTile(cv::Size size, cv::Size kernel, double& costNs)
+{
+  const CostModel& model = costModel();
+  const int largest = std::max(size.width + kernel.width, size.height + kernel.height);
+  costNs = 1e300;
+  int best = 0;
+  for (int side = std::max(kMinTile, 2 * std::max(kernel.width, kernel.height)); ; side *= 2)
+  {
+    const int tile = FFT::nextSmoothSize(side);
+    const double tilesX = std::ceil(size.width / static_cast<double>(tile - kernel.width + 1));
+    const double tilesY = std::ceil(size.height / static_cast<double>(tile - kernel.height + 1));
+    const double points = static_cast<double>(tile) * tile;
+    const double cost = tilesX * tilesY * points * std::log2(points) * model.fftPerPoint;
+    if (cost < costNs)
+    {
+      costNs = cost;
+      best = tile;
+    }
+    if (tile >= largest)
+    {
+      return best;
+    }
+  }
+}
+
+// Function to pick the cheapest route for filtering an image of `size`
+Choice choose(cv::Size size, const cv::Mat& kernel, int depth = CV_32F)
+{
+  const CostModel& model = costModel();
+  const double pixels = static_cast<double>(size.width) * size.height;
+  Choice choice;
+  choice.method = Method::Direct;
+  double cost = directCost(pixels, kernel.size());
+
+  if (separate(kernel, choice.kernelX, choice.kernelY))
+  {
+    const double separable = pixels * (kernel.rows + kernel.cols) * model.separablePerTap;
+    if (separable < cost)
+    {
+      cost = separable;
+      choice.method = Method::Separable;
+    }
+  }
+
+  // The FFT route works in single precision, so double images stay direct
+  double fft;
+  const int tile = bestTile(size, kernel.size(), fft);
+  if (depth != CV_64F && fft < cost)
+  {
+    cost = fft;
+    choice.method = Method::Fft;
+    choice.tile = tile;
+  }
+  choice.costMs = cost / 1e6;
+  return choice;
+}
+
+// Function to filter src with kernel like cv::filter2D(src, dst, -1, kernel,
+// center anchor, 0, borderType), by the given or the cheapest route.
+// Separable on a kernel that is not rank 1 falls back to direct.
+// threads: 0 = all cores (FFT route; OpenCV threads the other two)
+void filter2D(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel, int borderType = cv::BORDER_DEFAULT,
+              Method method = Method::Auto, int threads = 0)
+{
+  Choice choice;
+  if (method == Method::Auto)
+  {
+    choice = choose(src.size(), kernel, src.depth());
+  }
+  else
+  {
+    choice.method = method;
+    if (method == Method::Separable && !separate(kernel, choice.kernelX, choice.kernelY))
+    {
+      choice.method = Method::Direct;
+    }
+    if (method == Method::Fft)
+    {
+      double cost;
+      choice.tile = bestTile(src.size(), kernel.size(), cost);
+    }
+  }
+
+  switch (choice.method)
+  {
+    case Method::Separable:
+      cv::sepFilter2D(src, dst, -1, choice.kernelX, choice.kernelY, cv::Point(-1, -1), 0, borderType);
+      return;
+    case Method::Fft:
+    {
+      std::vector<cv::Mat> channels;
+      cv::split(src, channels);
+      for (cv::Mat& channel : channels)
+      {
+        cv::Mat in, out;
+        channel.convertTo(in, CV_32F);
+        correlateFft(in, out, kernel, borderType, choice.tile, threads);
+        out.convertTo(channel, src.depth());
+      }
+      cv::merge(channels, dst);
+      return;
+    }
+    default:
+      cv::filter2D(src, dst, -1, kernel, cv::Point(-1, -1), 0, borderType);
+  }
+}
+
+} // namespace convolution
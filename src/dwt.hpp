@@ -0,0 +1,444 @@
+/*
+  *dwt.hpp
+    Lifting-scheme 2D discrete wavelet transform for CV_32FC1 images
+  *Families: CDF 5/3, CDF 9/7 (biorthogonal, as in JPEG 2000) and the
+   orthogonal Daubechies wavelets with 4 and 8 taps (D4 = db2, D8 = db4).
+   All are scaled like the Haar transform in wavelets.hpp: the low-pass has
+   a DC gain of sqrt(2) per dimension.
+  *Any image size: lines are extended symmetrically (whole-sample mirror)
+   and a line of n samples gives ceil(n/2) low and floor(n/2) high
+   coefficients. Lifting is invertible whatever the extension, so the
+   inverse is exact up to rounding for every family and size.
+  *Layout after each level, as for the Haar transform:
+     [ LL | HL ]
+     [ LH | HH ]  with the next level working inside LL.
+  *Lines are processed kDwtLanes at a time: a block of rows (or columns) is
+   gathered into a buffer where sample i of every line is contiguous, so
+   each lifting step is a SIMD axpy over the block.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+#include "shrinkage.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+#include "wavelets.hpp"
+
+namespace wavelets
+{
+
+enum class Family
+{
+  CDF53,
+  CDF97,
+  Daubechies4,
+  Daubechies8
+};
+
+const char* familyName(Family family)
+{
+  switch (family)
+  {
+    case Family::CDF53:
+      return "CDF 5/3";
+    case Family::CDF97:
+      return "CDF 9/7";
+    case Family::Daubechies4:
+      return "Daubechies 4";
+    default:
+      return "Daubechies 8";
+  }
+}
+
+// Function to parse a family from its name ("CDF 9/7", case and spaces
+// ignored) or short name (cdf53, cdf97, d4, d8); false if unknown
+bool parseFamily(const std::string& name, Family& family)
+{
+  auto simplify = [](const std::string& text)
+  {
+    std::string result;
+    for (char c : text)
+    {
+      if (c != ' ' && c != '/')
+      {
+        result += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      }
+    }
+    return result;
+  };
+
+  const char* shortNames[] = {"cdf53", "cdf97", "d4", "d8"};
+  for (int i = 0; i <= static_cast<int>(Family::Daubechies8); i++)
+  {
+    const Family candidate = static_cast<Family>(i);
+    if (simplify(name) == simplify(familyName(candidate)) || simplify(name) == shortNames[i])
+    {
+      family = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+// One lifting step on the interleaved line: for every n,
+//   predict: odd[n]  += sum_j taps[j] * even[n + offset + j]
+//   update:  even[n] += sum_j taps[j] * odd[n + offset + j]
+struct LiftingStep
+{
+  bool predict;
+  int offset;
+  std::vector<float> taps;
+};
+
+struct LiftingScheme
+{
+  std::vector<LiftingStep> steps;
+  float lowScale;
+  float highScale;
+};
+
+// Function to get the lifting factorization of a wavelet family.
+// The Daubechies factorizations come from the Euclidean algorithm on the
+// polyphase components of the filters, plus a last predict step that makes
+// the high-pass the orthogonal one.
+const LiftingScheme& liftingScheme(Family family)
+{
+  static const LiftingScheme cdf53 = {{{true, 0, {-0.5f, -0.5f}}, {false, -1, {0.25f, 0.25f}}},
+                                      1.41421356237309505f,
+                                      0.70710678118654752f};
+  static const LiftingScheme cdf97 = {{{true, 0, {-1.586134342059924f, -1.586134342059924f}},
+                                       {false, -1, {-0.052980118572961f, -0.052980118572961f}},
+                                       {true, 0, {0.882911075530934f, 0.882911075530934f}},
+                                       {false, -1, {0.443506852043971f, 0.443506852043971f}}},
+                                      1.14960439886024f,
+                                      0.86986445162478f};
+  static const LiftingScheme daubechies4 = {{{true, 0, {-1.7320508075688772f}},
+                                             {false, 0, {0.43301270189221935f, -0.06698729810778069f}},
+                                             {true, -1, {1.0f}}},
+                                            1.9318516525781364f,
+                                            0.5176380902050416f};
+  static const LiftingScheme daubechies8 = {{{true, 0, {-3.102931485830335f}},
+                                             {false, 0, {0.35344918761777155f, 0.11602641034420509f}},
+                                             {true, 0, {-1.1327374041401568f, 0.1810902771462924f}},
+                                             {false, 0, {-0.06610055269004789f, -0.2214142101585277f}},
+                                             {true, -3, {0.23869459776041058f, -1.3483235209718485f,
+                                                         4.5164219554111815f}}},
+                                            2.2779381115220945f,
+                                            0.43899348930591026f};
+  switch (family)
+  {
+    case Family::CDF53:
+      return cdf53;
+    case Family::CDF97:
+      return cdf97;
+    case Family::Daubechies4:
+      return daubechies4;
+    default:
+      return daubechies8;
+  }
+}
+
+// Lines transformed together (one buffer sample = kDwtLanes floats)
+const int kDwtLanes = 16;
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+// y[i] += sum_j c[j] * x[j][i] for i in [begin, lanes), as many V-wide
+// lanes as fit. Returns the first lane not processed.
+template <typename V>
+SIMD_INLINE int liftLanes(float* y, const float* const* x, const float* c, int taps, int begin, int lanes)
+{
+  constexpr int L = simd::lanes<V, float>();
+  int i = begin;
+  for (; i + L <= lanes; i += L)
+  {
+    V acc = simd::load<V>(y + i);
+    for (int j = 0; j < taps; j++)
+    {
+      acc += c[j] * simd::load<V>(x[j] + i);
+    }
+    simd::store(y + i, acc);
+  }
+  return i;
+}
+
+template <typename V>
+SIMD_INLINE void liftLanes(float* y, const float* const* x, const float* c, int taps, int lanes)
+{
+  const int i = liftLanes<V>(y, x, c, taps, 0, lanes);
+  liftLanes<float>(y, x, c, taps, i, lanes);
+}
+
+// Per-instruction-set instantiations of liftLanes
+void liftLanesScalar(float* y, const float* const* x, const float* c, int taps, int lanes)
+{
+  liftLanes<float>(y, x, c, taps, 0, lanes);
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET("sse2") void liftLanesSse2(float* y, const float* const* x, const float* c, int taps, int lanes)
+{
+  liftLanes<simd::Vector<float, 16>::type>(y, x, c, taps, lanes);
+}
+
+SIMD_TARGET("avx2,fma") void liftLanesAvx2(float* y, const float* const* x, const float* c, int taps, int lanes)
+{
+  liftLanes<simd::Vector<float, 32>::type>(y, x, c, taps, lanes);
+}
+#endif
+
+#if defined(SIMD_NEON)
+void liftLanesNeon(float* y, const float* const* x, const float* c, int taps, int lanes)
+{
+  liftLanes<simd::Vector<float, 16>::type>(y, x, c, taps, lanes);
+}
+#endif
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+typedef void (*LiftLanesFn)(float*, const float* const*, const float*, int, int);
+
+// Best liftLanes kernel of the running CPU, picked once
+LiftLanesFn liftLanesKernel()
+{
+  static const LiftLanesFn kernel = []
+  {
+    switch (simd::bestIsa())
+    {
+#if defined(SIMD_X86)
+      case simd::Isa::AVX2:
+        return &liftLanesAvx2;
+      case simd::Isa::SSE2:
+        return &liftLanesSse2;
+#endif
+#if defined(SIMD_NEON)
+      case simd::Isa::NEON:
+        return &liftLanesNeon;
+#endif
+      default:
+        return &liftLanesScalar;
+    }
+  }();
+  return kernel;
+}
+
+// Function to mirror an index into [0, n) (whole-sample symmetric extension)
+inline int mirrorIndex(int i, int n)
+{
+  while (i < 0 || i >= n)
+  {
+    i = i < 0 ? -i : 2 * (n - 1) - i;
+  }
+  return i;
+}
+
+// Function to run the lifting steps on a block of n interleaved samples
+// (sample i at line + i * lanes). inverse runs them backwards, subtracting.
+void liftBlock(const LiftingScheme& scheme, float* line, int n, int lanes, bool inverse)
+{
+  if (n < 2)
+  {
+    return;
+  }
+  const LiftLanesFn lift = liftLanesKernel();
+  const int count = static_cast<int>(scheme.steps.size());
+  std::vector<float> taps;
+  std::vector<const float*> sources;
+  for (int s = 0; s < count; s++)
+  {
+    const LiftingStep& step = scheme.steps[inverse ? count - 1 - s : s];
+    taps.assign(step.taps.begin(), step.taps.end());
+    if (inverse)
+    {
+      for (float& t : taps)
+      {
+        t = -t;
+      }
+    }
+    sources.resize(taps.size());
+
+    // Predict writes the odd samples from the even ones, update the reverse
+    const int target = step.predict ? 1 : 0;
+    const int source = 1 - target;
+    for (int k = 0; 2 * k + target < n; k++)
+    {
+      for (std::size_t j = 0; j < taps.size(); j++)
+      {
+        const int i = 2 * (k + step.offset + static_cast<int>(j)) + source;
+        sources[j] = line + mirrorIndex(i, n) * lanes;
+      }
+      lift(line + (2 * k + target) * lanes, sources.data(), taps.data(), static_cast<int>(taps.size()), lanes);
+    }
+  }
+}
+
+// Function to copy `lanes` lines between the image and a block buffer:
+// buffer sample p <-> line sample position(p), multiplied by scale(p).
+// The loop order follows the memory layout, so that the image is always
+// walked along its rows.
+template <typename Position, typename Scale>
+void copyBlock(float* image, float* buffer, int lanes, int n, std::ptrdiff_t lineStep, std::ptrdiff_t sampleStep,
+               bool toBuffer, Position position, Scale scale)
+{
+  auto copy = [&](int p, int l)
+  {
+    float& pixel = image[l * lineStep + position(p) * sampleStep];
+    float& sample = buffer[p * kDwtLanes + l];
+    if (toBuffer)
+    {
+      sample = pixel * scale(p);
+    }
+    else
+    {
+      pixel = sample * scale(p);
+    }
+  };
+  if (sampleStep == 1)
+  {
+    for (int l = 0; l < lanes; l++)
+    {
+      for (int p = 0; p < n; p++)
+      {
+        copy(p, l);
+      }
+    }
+  }
+  else
+  {
+    for (int p = 0; p < n; p++)
+    {
+      for (int l = 0; l < lanes; l++)
+      {
+        copy(p, l);
+      }
+    }
+  }
+}
+
+// Function to transform `count` lines of n samples: line l, sample i is at
+// base + l * lineStep + i * sampleStep. Forward: the low coefficients go to
+// samples [0, ceil(n/2)), the high ones after them; inverse undoes it.
+void transformLines(const LiftingScheme& scheme, float* base, int count, int n, std::ptrdiff_t lineStep,
+                    std::ptrdiff_t sampleStep, bool inverse, int threads)
+{
+  const int blocks = (count + kDwtLanes - 1) / kDwtLanes;
+  const int lowCount = (n + 1) / 2;
+  // Even samples are the low band, odd samples the high band
+  auto deinterleaved = [lowCount](int p) { return p % 2 ? lowCount + p / 2 : p / 2; };
+  auto interleaved = [](int p) { return p; };
+  auto bandScale = [&scheme](int p) { return p % 2 ? scheme.highScale : scheme.lowScale; };
+  auto inverseScale = [&scheme](int p) { return p % 2 ? 1.0f / scheme.highScale : 1.0f / scheme.lowScale; };
+  auto unit = [](int) { return 1.0f; };
+  threading::defaultPool().parallelFor(
+      blocks,
+      [&](int begin, int end, int)
+      {
+        std::vector<float> buffer(static_cast<std::size_t>(n) * kDwtLanes);
+        for (int b = begin; b < end; b++)
+        {
+          const int lanes = std::min(kDwtLanes, count - b * kDwtLanes);
+          float* lines = base + b * kDwtLanes * lineStep;
+          if (inverse)
+          {
+            copyBlock(lines, buffer.data(), lanes, n, lineStep, sampleStep, true, deinterleaved, inverseScale);
+            liftBlock(scheme, buffer.data(), n, kDwtLanes, true);
+            copyBlock(lines, buffer.data(), lanes, n, lineStep, sampleStep, false, interleaved, unit);
+          }
+          else
+          {
+            copyBlock(lines, buffer.data(), lanes, n, lineStep, sampleStep, true, interleaved, unit);
+            liftBlock(scheme, buffer.data(), n, kDwtLanes, false);
+            copyBlock(lines, buffer.data(), lanes, n, lineStep, sampleStep, false, deinterleaved, bandScale);
+          }
+        }
+      },
+      threads);
+}
+
+// In-place multi-level 2D DWT of a CV_32FC1 image (rows, then columns, per
+// level). threads: 0 = all cores, 1 = serial.
+void dwtForward(cv::Mat& image, Family family, int levels, int threads = 0)
+{
+  CV_Assert(image.type() == CV_32FC1);
+  const LiftingScheme& scheme = liftingScheme(family);
+  const std::ptrdiff_t step = image.step1();
+  int rows = image.rows;
+  int cols = image.cols;
+  for (int k = 0; k < levels && rows > 1 && cols > 1; k++)
+  {
+    float* data = image.ptr<float>(0);
+    transformLines(scheme, data, rows, cols, step, 1, false, threads);
+    transformLines(scheme, data, cols, rows, 1, step, false, threads);
+    rows = (rows + 1) / 2;
+    cols = (cols + 1) / 2;
+  }
+}
+
+// Function to get the size of the LL band of every level, finest first
+std::vector<cv::Size> dwtLevelSizes(cv::Size size, int levels)
+{
+  std::vector<cv::Size> sizes;
+  for (int k = 0; k < levels && size.height > 1 && size.width > 1; k++)
+  {
+    sizes.push_back(size);
+    size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+  }
+  return sizes;
+}
+
+// Function to list the detail subbands of a dwtForward result: HL, LH, HH
+// of every level, finest level first (the layout of shrinkage::haarSubbands,
+// with the low half rounded up)
+std::vector<cv::Rect> dwtSubbands(cv::Size size, int levels)
+{
+  std::vector<cv::Rect> subbands;
+  for (const cv::Size& level : dwtLevelSizes(size, levels))
+  {
+    const int lowH = (level.height + 1) / 2;
+    const int lowW = (level.width + 1) / 2;
+    subbands.push_back(cv::Rect(lowW, 0, level.width - lowW, lowH));
+    subbands.push_back(cv::Rect(0, lowH, lowW, level.height - lowH));
+    subbands.push_back(cv::Rect(lowW, lowH, level.width - lowW, level.height - lowH));
+  }
+  return subbands;
+}
+
+// Applies shrinkage (HARD, SOFT or GARROT with threshold T, see shrinkage.hpp)
+// to every detail coefficient of a dwtForward result; the coarsest LL band is kept
+void shrinkDetails(cv::Mat& coefficients, int levels, int shrinkageType, float T, int threads = 0)
+{
+  shrinkage::shrinkSubbands(coefficients, dwtSubbands(coefficients.size(), levels), shrinkageType, T, threads);
+}
+
+// In-place inverse of dwtForward; shrinkage as in cvInvHaarWavelet is
+// applied to the detail coefficients first
+void dwtInverse(cv::Mat& coefficients, Family family, int levels, int shrinkageType = NONE, float T = 50,
+                int threads = 0)
+{
+  CV_Assert(coefficients.type() == CV_32FC1);
+  shrinkDetails(coefficients, levels, shrinkageType, T, threads);
+
+  const LiftingScheme& scheme = liftingScheme(family);
+  const std::ptrdiff_t step = coefficients.step1();
+  const std::vector<cv::Size> sizes = dwtLevelSizes(coefficients.size(), levels);
+  for (auto size = sizes.rbegin(); size != sizes.rend(); ++size)
+  {
+    float* data = coefficients.ptr<float>(0);
+    transformLines(scheme, data, size->width, size->height, 1, step, true, threads);
+    transformLines(scheme, data, size->height, size->width, step, 1, true, threads);
+  }
+}
+
+} // namespace wavelets
@@ -1,117 +1,379 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <opencv2/opencv.hpp>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
 
-void idealLpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0)
+#include "simd.hpp"
+
+#if defined(SIMD_X86)
+#include <immintrin.h>
+#endif
+
+/*
+  Every filter below only depends on the distance D from the center of the
+  (centered) spectrum, so they are all written as a 1D radial profile H(D)
+  and filled in by radialFilter:
+  *the distance map of an image size is computed once and reused,
+  *smooth profiles are tabulated into a lookup table, finely enough for the
+   width of the filter, and H is filled by an interpolated (AVX2) gather;
+   the most recent tables are kept for reuse,
+  *profiles with hard edges (ideal, band pass, notch) are compared exactly
+   against the map, so the cut-off lands on the same pixels as before,
+  *the Gaussians are also separable and skip all of this (separableGaussianFilter).
+  A new radial filter only needs a profile struct like the ones below.
+*/
+
+// Samples per unit of filter scale (D0) in a profile lookup table
+const int kProfileSamplesPerScale = 256;
+// Upper bound on the lookup table length
+const int kMaxProfileSamples = 1 << 22;
+// The table is built in blocks and ends after the first block whose values
+// stay within the tolerance (the profile has converged)
+const int kProfileBlock = 1024;
+const float kProfileFlatTolerance = 1e-7f;
+// Profile tables kept for reuse (see profileTable)
+const std::size_t kProfileTableCacheSize = 16;
+
+// Function to get the distance map of a rows x cols spectrum:
+// D(u, v) = sqrt((u - rows/2)^2 + (v - cols/2)^2) as CV_32F.
+// The map of the most recent size is kept and shared.
+std::shared_ptr<const cv::Mat> distanceMap(int rows, int cols)
 {
-  for (int u = 0; u < H.rows; u++)
+  static std::mutex mutex;
+  static std::shared_ptr<const cv::Mat> last;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (last && last->rows == rows && last->cols == cols)
   {
-    for (int v = 0; v < H.cols; v++)
+    return last;
+  }
+
+  auto map = std::make_shared<cv::Mat>(rows, cols, CV_32F);
+  for (int u = 0; u < rows; u++)
+  {
+    const int du2 = (u - rows / 2) * (u - rows / 2);
+    float* d = map->ptr<float>(u);
+    for (int v = 0; v < cols; v++)
     {
-      D = sqrt((u - scr.rows / 2) * (u - scr.rows / 2) + (v - scr.cols / 2) * (v - scr.cols / 2));
-      if (D > D0)
-      {
-        H.at<float>(u, v) = 0;
-      }
+      d[v] = std::sqrt(static_cast<float>(du2 + (v - cols / 2) * (v - cols / 2)));
     }
   }
+  last = map;
+  return last;
 }
 
-void gaussianLpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0)
+// Function to look up n distances in a profile table with linear interpolation.
+// Positions past maxX (the flat tail that was cut off) are clamped to it.
+void profileGather(const float* D, float* out, int n, const float* lut, float invStep, float maxX)
 {
-  for (int u = 0; u < H.rows; u++)
+  for (int i = 0; i < n; i++)
   {
-    for (int v = 0; v < H.cols; v++)
+    const float x = std::min(D[i] * invStep, maxX);
+    const int k = static_cast<int>(x);
+    out[i] = lut[k] + (x - k) * (lut[k + 1] - lut[k]);
+  }
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET("avx2,fma")
+void profileGatherAvx2(const float* D, float* out, int n, const float* lut, float invStep, float maxX)
+{
+  const __m256 scale = _mm256_set1_ps(invStep);
+  const __m256 limit = _mm256_set1_ps(maxX);
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    const __m256 x = _mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(D + i), scale), limit);
+    const __m256i k = _mm256_cvttps_epi32(x);
+    const __m256 t = _mm256_sub_ps(x, _mm256_cvtepi32_ps(k));
+    const __m256 a = _mm256_i32gather_ps(lut, k, 4);
+    const __m256 b = _mm256_i32gather_ps(lut + 1, k, 4);
+    _mm256_storeu_ps(out + i, _mm256_fmadd_ps(t, _mm256_sub_ps(b, a), a));
+  }
+  profileGather(D + i, out + i, n - i, lut, invStep, maxX);
+}
+#endif
+
+// Lookup table of a smooth profile: lut[k] = H(k / invStep), k <= maxX + 1
+struct ProfileTable
+{
+  std::vector<float> lut;
+  float invStep = 0.0f;
+  float maxX = 0.0f;
+};
+
+// Function to tabulate a smooth profile over [0, maxD] (+2 samples for the
+// interpolation), a block at a time. Once a whole block is flat the profile
+// has reached its limit; the rest is dropped, which keeps the table cache-sized.
+template <typename Profile>
+std::shared_ptr<const ProfileTable> buildProfileTable(const Profile& profile, double maxD)
+{
+  auto table = std::make_shared<ProfileTable>();
+  double step = std::min(1.0 / 16, profile.scale() / kProfileSamplesPerScale);
+  step = std::max(step, maxD / (kMaxProfileSamples - 2));
+  const int samples = static_cast<int>(maxD / step) + 2;
+  for (int begin = 0; begin < samples; begin += kProfileBlock)
+  {
+    const int end = std::min(samples, begin + kProfileBlock);
+    float low = profile(begin * step);
+    float high = low;
+    for (int k = begin; k < end; k++)
     {
-      D = sqrt((u - scr.rows / 2) * (u - scr.rows / 2) + (v - scr.cols / 2) * (v - scr.cols / 2));
-      H.at<float>(u, v) = exp(-D * D / (2 * D0 * D0));
+      table->lut.push_back(profile(k * step));
+      low = std::min(low, table->lut.back());
+      high = std::max(high, table->lut.back());
+    }
+    if (begin > 0 && high - low <= kProfileFlatTolerance)
+    {
+      break;
     }
   }
+  table->invStep = static_cast<float>(1.0 / step);
+  table->maxX = static_cast<float>(table->lut.size() - 2);
+  return table;
 }
 
-void idealHpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0)
+// Function to get the table of a smooth profile. The most recent tables are
+// kept (keyed by profile type, parameters and maxD), so filtering the same
+// way again, e.g. every frame of a stream, neither rebuilds nor allocates one.
+template <typename Profile>
+std::shared_ptr<const ProfileTable> profileTable(const Profile& profile, double maxD)
 {
-  for (int u = 0; u < H.rows; u++)
+  static_assert(std::is_trivially_copyable<Profile>::value && sizeof(Profile) <= 16, "profile must be a small POD");
+  typedef std::tuple<std::size_t, std::array<unsigned char, 16>, double> Key;
+  static std::mutex mutex;
+  static std::list<std::pair<Key, std::shared_ptr<const ProfileTable>>> tables; // Most recent first
+
+  Key key(typeid(Profile).hash_code(), std::array<unsigned char, 16>{}, maxD);
+  std::memcpy(std::get<1>(key).data(), &profile, sizeof(Profile));
   {
-    for (int v = 0; v < H.cols; v++)
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto entry = tables.begin(); entry != tables.end(); ++entry)
     {
-      D = sqrt((u - scr.rows / 2) * (u - scr.rows / 2) + (v - scr.cols / 2) * (v - scr.cols / 2));
-      if (D < D0)
+      if (entry->first == key)
       {
-        H.at<float>(u, v) = 0;
+        tables.splice(tables.begin(), tables, entry);
+        return entry->second;
       }
     }
   }
+
+  std::shared_ptr<const ProfileTable> table = buildProfileTable(profile, maxD);
+  std::lock_guard<std::mutex> lock(mutex);
+  tables.emplace_front(key, table);
+  if (tables.size() > kProfileTableCacheSize)
+  {
+    tables.pop_back();
+  }
+  return table;
 }
 
-void gaussianHpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0)
+// Evaluates a radial profile for rows of distances: hard-edged profiles
+// directly, smooth ones through an interpolated lookup table (shared, so
+// copies are cheap)
+template <typename Profile>
+class RadialEvaluator
 {
-  for (int u = 0; u < H.rows; u++)
+public:
+  // maxD: largest distance that will be looked up
+  RadialEvaluator(const Profile& profile, double maxD) : profile_(profile)
   {
-    for (int v = 0; v < H.cols; v++)
+    if constexpr (!Profile::hardEdged)
     {
-      D = sqrt((u - scr.rows / 2) * (u - scr.rows / 2) + (v - scr.cols / 2) * (v - scr.cols / 2));
-      H.at<float>(u, v) = 1 - exp(-D * D / (2 * D0 * D0));
+      table_ = profileTable(profile, maxD);
     }
   }
-}
 
-void bandPassFilter(cv::Mat& scr, cv::Mat& H, float D, float D0)
-{
-  float D1 = D0 * 0.75;
-  float D2 = D0 * 1.25;
-  for (int u = 0; u < H.rows; u++)
+  // out[i] = H(D[i]) for n distances
+  void operator()(const float* D, float* out, int n) const
   {
-    for (int v = 0; v < H.cols; v++)
+    if constexpr (Profile::hardEdged)
+    {
+      for (int i = 0; i < n; i++)
+      {
+        out[i] = profile_(D[i]);
+      }
+    }
+    else
     {
-      D = sqrt((u - scr.rows / 2) * (u - scr.rows / 2) + (v - scr.cols / 2) * (v - scr.cols / 2));
-      if (D < D1 || D > D2)
+#if defined(SIMD_X86)
+      if (simd::bestIsa() == simd::Isa::AVX2)
       {
-        H.at<float>(u, v) = 0;
+        profileGatherAvx2(D, out, n, table_->lut.data(), table_->invStep, table_->maxX);
+        return;
       }
+#endif
+      profileGather(D, out, n, table_->lut.data(), table_->invStep, table_->maxX);
     }
   }
+
+private:
+  Profile profile_;
+  std::shared_ptr<const ProfileTable> table_;
+};
+
+// Function to get the largest distance from the center of a rows x cols spectrum
+double maxRadialDistance(int rows, int cols)
+{
+  const double cy = rows / 2 + 1;
+  const double cx = cols / 2 + 1;
+  return std::sqrt(cy * cy + cx * cx);
 }
 
-void notchFilter(cv::Mat& scr, cv::Mat& H, float D, float D0)
+// Function to fill H with a radial profile (see the profile structs below)
+template <typename Profile>
+void radialFilter(cv::Mat& H, const Profile& profile)
 {
-  float D1 = D0 * 0.75;
-  float D2 = D0 * 1.25;
+  CV_Assert(H.type() == CV_32F);
+  const std::shared_ptr<const cv::Mat> D = distanceMap(H.rows, H.cols);
+  const RadialEvaluator<Profile> evaluate(profile, maxRadialDistance(H.rows, H.cols));
   for (int u = 0; u < H.rows; u++)
   {
+    evaluate(D->ptr<float>(u), H.ptr<float>(u), H.cols);
+  }
+}
+
+// Function to get a 1D Gaussian exp(-d^2 / (2 D0^2)) of the distance d = i - center, i < n
+std::vector<float> gaussianProfile(int n, int center, float D0)
+{
+  std::vector<float> g(n);
+  for (int i = 0; i < n; i++)
+  {
+    const double d = i - center;
+    g[i] = static_cast<float>(std::exp(-d * d / (2.0 * D0 * D0)));
+  }
+  return g;
+}
+
+// Function to fill H with a Gaussian low pass (or 1 minus it for the high
+// pass). exp(-D^2 / (2 D0^2)) splits into a row profile times a column
+// profile, so H is an outer product of two vectors: no distance map, no
+// table and one exp per row and column instead of one per pixel.
+void separableGaussianFilter(cv::Mat& H, float D0, bool highPass)
+{
+  CV_Assert(H.type() == CV_32F);
+  const std::vector<float> gy = gaussianProfile(H.rows, H.rows / 2, D0);
+  const std::vector<float> gx = gaussianProfile(H.cols, H.cols / 2, D0);
+  for (int u = 0; u < H.rows; u++)
+  {
+    float* h = H.ptr<float>(u);
     for (int v = 0; v < H.cols; v++)
     {
-      D = sqrt((u - scr.rows / 2) * (u - scr.rows / 2) + (v - scr.cols / 2) * (v - scr.cols / 2));
-      if (D >= D1 && D <= D2)
-      {
-        H.at<float>(u, v) = 0;
-      }
+      h[v] = highPass ? 1 - gy[u] * gx[v] : gy[u] * gx[v];
     }
   }
 }
 
+// Radial profiles: operator() gives H at distance D, scale() the width of
+// the transition (used to pick the table resolution)
+struct IdealLpProfile
+{
+  static const bool hardEdged = true;
+  float D0;
+  float operator()(float D) const { return D > D0 ? 0.0f : 1.0f; }
+};
+
+struct IdealHpProfile
+{
+  static const bool hardEdged = true;
+  float D0;
+  float operator()(float D) const { return D < D0 ? 0.0f : 1.0f; }
+};
+
+struct BandPassProfile
+{
+  static const bool hardEdged = true;
+  float D1, D2;
+  float operator()(float D) const { return (D < D1 || D > D2) ? 0.0f : 1.0f; }
+};
+
+struct NotchProfile
+{
+  static const bool hardEdged = true;
+  float D1, D2;
+  float operator()(float D) const { return (D >= D1 && D <= D2) ? 0.0f : 1.0f; }
+};
+
+struct GaussianLpProfile
+{
+  static const bool hardEdged = false;
+  float D0;
+  double scale() const { return D0; }
+  float operator()(double D) const { return std::exp(-D * D / (2.0 * D0 * D0)); }
+};
+
+struct GaussianHpProfile
+{
+  static const bool hardEdged = false;
+  float D0;
+  double scale() const { return D0; }
+  float operator()(double D) const { return 1 - std::exp(-D * D / (2.0 * D0 * D0)); }
+};
+
+struct ButterworthLpProfile
+{
+  static const bool hardEdged = false;
+  float D0;
+  int n;
+  double scale() const { return D0 / std::max(1, n); }
+  float operator()(double D) const { return 1 / (1 + std::pow(D / D0, 2 * n)); }
+};
+
+struct ChebyshevLpProfile
+{
+  static const bool hardEdged = false;
+  float D0;
+  float epsilon;
+  int n;
+  double scale() const { return D0 / std::max(1, n); }
+  float operator()(double D) const
+  {
+    const double term = std::pow(D / D0, n);
+    const double chebyshevTerm = 1 + std::pow(epsilon * std::cosh(term), 2);
+    return 1 / std::sqrt(chebyshevTerm);
+  }
+};
+
+void idealLpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0) { radialFilter(H, IdealLpProfile{D0}); }
+
+void gaussianLpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0) { separableGaussianFilter(H, D0, false); }
+
+void idealHpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0) { radialFilter(H, IdealHpProfile{D0}); }
+
+void gaussianHpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0) { separableGaussianFilter(H, D0, true); }
+
+void bandPassFilter(cv::Mat& scr, cv::Mat& H, float D, float D0)
+{
+  float D1 = D0 * 0.75;
+  float D2 = D0 * 1.25;
+  radialFilter(H, BandPassProfile{D1, D2});
+}
+
+void notchFilter(cv::Mat& scr, cv::Mat& H, float D, float D0)
+{
+  float D1 = D0 * 0.75;
+  float D2 = D0 * 1.25;
+  radialFilter(H, NotchProfile{D1, D2});
+}
+
 void butterworthLpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0, int n)
 {
-    for (int u = 0; u < H.rows; u++)
-    {
-        for (int v = 0; v < H.cols; v++)
-        {
-            D = sqrt((u - scr.rows / 2) * (u - scr.rows / 2) + (v - scr.cols / 2) * (v - scr.cols / 2));
-            H.at<float>(u, v) = 1 / (1 + pow(D / D0, 2 * n));
-        }
-    }
+  radialFilter(H, ButterworthLpProfile{D0, n});
 }
 
 void chebyshevLpFilter(cv::Mat& scr, cv::Mat& H, float D, float D0, float epsilon, int n)
 {
-    for (int u = 0; u < H.rows; u++)
-    {
-        for (int v = 0; v < H.cols; v++)
-        {
-            D = sqrt((u - scr.rows / 2) * (u - scr.rows / 2) + (v - scr.cols / 2) * (v - scr.cols / 2));
-            float term = pow((D / D0), n);
-            float chebyshevTerm = 1 + pow(epsilon * cosh(term), 2);
-            H.at<float>(u, v) = 1 / sqrt(chebyshevTerm);
-        }
-    }
-}
\ No newline at end of file
+  radialFilter(H, ChebyshevLpProfile{D0, epsilon, n});
+}
@@ -0,0 +1,163 @@
+/*
+  *filter_cache.hpp
+    Bounded LRU cache of transfer functions H built by construct_H
+  *Entries are keyed by (rows, cols) and the (filter type, D0, n, epsilon) of
+   every filter in the chain, and handed out as shared read-only matrices, so
+   an evicted H stays valid for as long as a caller still holds it.
+  *The cache is capped in bytes; the least recently used entries are evicted
+   first. Lookups are thread-safe.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "image_processing.hpp"
+
+namespace image_processing
+{
+
+class FilterCache
+{
+public:
+  struct Stats
+  {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+  };
+
+  explicit FilterCache(std::size_t maxBytes) : maxBytes_(maxBytes) {}
+
+  FilterCache(const FilterCache&) = delete;
+  FilterCache& operator=(const FilterCache&) = delete;
+
+  // Returns H for the size of `scr`, building it on a miss
+  std::shared_ptr<const cv::Mat> get(cv::Mat& scr, const FilterSpec& spec)
+  {
+    return get(scr, std::vector<FilterSpec>{spec});
+  }
+
+  // Returns the combined H of an ordered chain (see construct_H), building it on a miss
+  std::shared_ptr<const cv::Mat> get(cv::Mat& scr, const std::vector<FilterSpec>& chain)
+  {
+    const Key key = makeKey(scr.rows, scr.cols, chain);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = index_.find(key);
+      if (found != index_.end())
+      {
+        ++stats_.hits;
+        entries_.splice(entries_.begin(), entries_, found->second);
+        return found->second->H;
+      }
+      ++stats_.misses;
+    }
+
+    // Built outside the lock so other sizes/filters are not held up
+    auto H = std::make_shared<const cv::Mat>(chain.size() == 1 ? construct_H(scr, chain[0])
+                                                               : construct_H(scr, chain));
+    const std::size_t bytes = H->total() * H->elemSize();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (bytes > maxBytes_)
+    {
+      return H; // Too large to ever fit, not cached
+    }
+    auto found = index_.find(key);
+    if (found != index_.end())
+    {
+      return found->second->H; // Another thread built it meanwhile
+    }
+    entries_.push_front(Entry{key, H, bytes});
+    index_[key] = entries_.begin();
+    stats_.bytes += bytes;
+    ++stats_.entries;
+    while (stats_.bytes > maxBytes_)
+    {
+      stats_.bytes -= entries_.back().bytes;
+      index_.erase(entries_.back().key);
+      entries_.pop_back();
+      --stats_.entries;
+      ++stats_.evictions;
+    }
+    return H;
+  }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  std::size_t maxBytes() const { return maxBytes_; }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+    stats_.entries = 0;
+    stats_.bytes = 0;
+  }
+
+  void printStats(std::ostream& out = std::cout) const
+  {
+    const Stats s = stats();
+    out << "H cache: " << s.hits << " hits, " << s.misses << " misses, " << s.evictions << " evictions, "
+        << s.entries << " entries (" << s.bytes / (1024.0 * 1024.0) << " of " << maxBytes_ / (1024.0 * 1024.0)
+        << " MiB)\n";
+  }
+
+private:
+  typedef std::tuple<FilterType, float, int, float> SpecKey;
+  typedef std::tuple<int, int, std::vector<SpecKey>> Key;
+
+  struct Entry
+  {
+    Key key;
+    std::shared_ptr<const cv::Mat> H;
+    std::size_t bytes;
+  };
+
+  // n and epsilon are dropped for filters that ignore them, so e.g. two
+  // Gaussian LP requests with different leftover orders share one entry
+  static Key makeKey(int rows, int cols, const std::vector<FilterSpec>& chain)
+  {
+    std::vector<SpecKey> specs;
+    specs.reserve(chain.size());
+    for (const FilterSpec& spec : chain)
+    {
+      const bool usesOrder = spec.type == FilterType::ButterworthLp || spec.type == FilterType::ChebyshevLp;
+      const bool usesEpsilon = spec.type == FilterType::ChebyshevLp;
+      specs.emplace_back(spec.type, spec.D0, usesOrder ? spec.n : 0, usesEpsilon ? spec.epsilon : 0.0f);
+    }
+    return Key(rows, cols, std::move(specs));
+  }
+
+  std::size_t maxBytes_;
+  std::list<Entry> entries_; // Most recently used first
+  std::map<Key, std::list<Entry>::iterator> index_;
+  Stats stats_;
+  mutable std::mutex mutex_;
+};
+
+// Process-wide cache used by the menu and streaming for their H (64 MiB)
+FilterCache& filterCache()
+{
+  static FilterCache cache(64u << 20);
+  return cache;
+}
+
+} // namespace image_processing
@@ -13,8 +13,8 @@ void displayImage(const cv::Mat& image, const std::string& windowName)
   cv::destroyAllWindows();
 }
 
-// Function to save an image
-void saveImage(const cv::Mat& image, const std::string& filename) { cv::imwrite(filename, image); }
+// Function to save an image; false if it could not be written
+bool saveImage(const cv::Mat& image, const std::string& filename) { return cv::imwrite(filename, image); }
 
 // Function to display multiple images
 void displayImages(const std::vector<cv::Mat>& images, const std::vector<std::string>& windowNames)
@@ -40,6 +40,7 @@ void menuPrompts()
   std::cout << "6. Notch\n";
   std::cout << "7. Butterworth LP\n";
   std::cout << "8. Chebyshev LP\n";
-  std::cout << "Enter your choice (1-8): ";
+  std::cout << "9. Chain of filters (applied in one pass)\n";
+  std::cout << "Enter your choice (1-9): ";
 }
 } // namespace helpers
@@ -0,0 +1,173 @@
+/*
+  *iir_gaussian.hpp
+    Recursive (IIR) Gaussian blur after Young & van Vliet: a third-order
+    causal pass and an anti-causal pass per axis, a few multiply-adds per
+    pixel whatever sigma is.
+  *The image is treated as periodic, like the DFT sees it: every line is
+   extended on both sides by kPaddingSigmas * sigma samples taken from the
+   other end, which lets the recursion settle before it reaches the image.
+  *The recursion matches the Gaussian to about 1% of its peak for sigma >= 3
+   and 2% at sigma = 2; narrower blurs are left to the DFT route.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace iir
+{
+
+// Wrap-around samples on each side of a line, in units of sigma
+const double kPaddingSigmas = 4.0;
+// Columns filtered together by the vertical pass
+const int kColumnBlock = 64;
+// Smallest sigma the recursion approximates well
+const double kMinSigma = 2.0;
+
+// Normalized recursion: y[n] = B x[n] + a1 y[n-1] + a2 y[n-2] + a3 y[n-3]
+struct Coefficients
+{
+  float B;
+  float a1;
+  float a2;
+  float a3;
+};
+
+// Function to get the coefficients for a standard deviation (in samples).
+// The three poles of van Vliet, Young & Verbeek (1998, L-infinity fit) for
+// sigma = 2 are scaled by the power 1/q, with q found by bisection so that the
+// variance of the causal plus anti-causal pair, sum of 2 d / (d - 1)^2 over
+// the poles, equals sigma^2.
+Coefficients coefficients(double sigma)
+{
+  const std::complex<double> poles[3] = {{1.40098, 1.00236}, {1.40098, -1.00236}, {1.85132, 0.0}};
+  auto scaled = [&](int k, double q)
+  { return std::polar(std::pow(std::abs(poles[k]), 1.0 / q), std::arg(poles[k]) / q); };
+  auto variance = [&](double q)
+  {
+    std::complex<double> sum = 0.0;
+    for (int k = 0; k < 3; k++)
+    {
+      const std::complex<double> d = scaled(k, q);
+      sum += 2.0 * d / ((d - 1.0) * (d - 1.0));
+    }
+    return sum.real();
+  };
+  double low = 0.1;
+  double high = 2.0 * sigma + 1.0;
+  for (int i = 0; i < 60; i++)
+  {
+    const double q = 0.5 * (low + high);
+    (variance(q) < sigma * sigma ? low : high) = q;
+  }
+  const double q = 0.5 * (low + high);
+  const std::complex<double> d1 = scaled(0, q);
+  const std::complex<double> d2 = scaled(1, q);
+  const std::complex<double> d3 = scaled(2, q);
+  const double product = (d1 * d2 * d3).real();
+  Coefficients c;
+  c.a1 = static_cast<float>((d1 * d2 + d1 * d3 + d2 * d3).real() / product);
+  c.a2 = static_cast<float>(-(d1 + d2 + d3).real() / product);
+  c.a3 = static_cast<float>(1.0 / product);
+  c.B = 1.0f - (c.a1 + c.a2 + c.a3);
+  return c;
+}
+
+// Samples of wrap-around padding for a sigma
+int padding(double sigma) { return static_cast<int>(std::ceil(kPaddingSigmas * sigma)); }
+
+// Function to filter `count` interleaved lines in place: sample i of line j is
+// data[i * count + j]. Both passes start from the steady state of the first
+// sample, so a constant line stays constant.
+void filterLines(float* data, int length, int count, const Coefficients& c)
+{
+  for (int direction = 0; direction < 2; direction++)
+  {
+    const int step = direction == 0 ? count : -count;
+    float* first = direction == 0 ? data : data + static_cast<std::ptrdiff_t>(length - 1) * count;
+    std::vector<float> y1(first, first + count), y2(y1), y3(y1);
+    float* p = first;
+    for (int i = 0; i < length; i++, p += step)
+    {
+      for (int j = 0; j < count; j++)
+      {
+        const float y = c.B * p[j] + c.a1 * y1[j] + c.a2 * y2[j] + c.a3 * y3[j];
+        y3[j] = y2[j];
+        y2[j] = y1[j];
+        y1[j] = y;
+        p[j] = y;
+      }
+    }
+  }
+}
+
+// Periodic Gaussian blur of a CV_32FC1 image with standard deviations
+// sigmaX (along rows) and sigmaY (along columns), in pixels.
+// threads: 0 = all cores, 1 = serial
+void gaussianBlur(const cv::Mat& src, cv::Mat& dst, double sigmaX, double sigmaY, int threads = 0)
+{
+  CV_Assert(src.type() == CV_32FC1);
+  const int rows = src.rows;
+  const int cols = src.cols;
+  const Coefficients cx = coefficients(sigmaX);
+  const Coefficients cy = coefficients(sigmaY);
+  const int padX = padding(sigmaX);
+  const int padY = padding(sigmaY);
+  auto wrap = [](int i, int n) { return ((i % n) + n) % n; };
+  threading::ThreadPool& pool = threading::defaultPool();
+  cv::Mat result(rows, cols, CV_32F);
+
+  // Along the rows, one padded row at a time
+  pool.parallelFor(
+      rows,
+      [&](int begin, int end, int)
+      {
+        std::vector<float> line(cols + 2 * padX);
+        for (int y = begin; y < end; y++)
+        {
+          const float* in = src.ptr<float>(y);
+          for (int i = 0; i < cols + 2 * padX; i++)
+          {
+            line[i] = in[wrap(i - padX, cols)];
+          }
+          filterLines(line.data(), cols + 2 * padX, 1, cx);
+          std::copy(line.begin() + padX, line.begin() + padX + cols, result.ptr<float>(y));
+        }
+      },
+      threads);
+
+  // Along the columns, kColumnBlock columns at a time so whole rows are read
+  const int blocks = (cols + kColumnBlock - 1) / kColumnBlock;
+  pool.parallelFor(
+      blocks,
+      [&](int begin, int end, int)
+      {
+        std::vector<float> lines(static_cast<std::size_t>(rows + 2 * padY) * kColumnBlock);
+        for (int b = begin; b < end; b++)
+        {
+          const int x0 = b * kColumnBlock;
+          const int width = std::min(kColumnBlock, cols - x0);
+          for (int i = 0; i < rows + 2 * padY; i++)
+          {
+            const float* in = result.ptr<float>(wrap(i - padY, rows)) + x0;
+            std::copy(in, in + width, lines.begin() + static_cast<std::size_t>(i) * width);
+          }
+          filterLines(lines.data(), rows + 2 * padY, width, cy);
+          for (int y = 0; y < rows; y++)
+          {
+            const float* line = lines.data() + static_cast<std::size_t>(y + padY) * width;
+            std::copy(line, line + width, result.ptr<float>(y) + x0);
+          }
+        }
+      },
+      threads);
+  dst = result;
+}
+
+} // namespace iir
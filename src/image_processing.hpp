@@ -1,20 +1,32 @@
 #pragma once
 
+#include <cctype>
+#include <memory>
 #include <opencv2/core.hpp>
 #include <opencv2/core/mat.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/opencv.hpp>
+#include <sstream>
+#include <string>
+#include <variant>
+#include <vector>
 
+#include "FFT.hpp"
+#include "convolution.hpp"
 #include "fft_filters.hpp"
 #include "helpers.hpp"
+#include "iir_gaussian.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
 
 namespace image_processing
 {
 
 cv::Mat generateHistogram(const cv::Mat& img)
 {
+  PROFILE_SCOPE("generateHistogram", img.total() * img.elemSize());
   // Establish the number of bins
   int histSize = 256;
 
@@ -72,126 +84,610 @@ void showHistogram(const cv::Mat& img, std::string plotTitle = "Histogram")
   cv::imshow(plotTitle, histImage);
 }
 
-void calculateDFT(cv::Mat& scr, cv::Mat& dst)
-{
-  cv::Mat scr32;
-  // Converting from 8-bit to float type suitable for DFT and Wavelets operations
-  scr.convertTo(scr32, CV_32F);
-  // define mat consists of two mat, one for real values and the other for complex values
-  cv::Mat planes[] = {scr32, cv::Mat::zeros(scr.size(), CV_32F)};
-  cv::Mat complexImg;
-  merge(planes, 2, complexImg);
-  dft(complexImg, complexImg);
-  dst = complexImg;
+// Forward DFT of a real image. Only the Hermitian half of the spectrum
+// (rows x (cols/2 + 1), CV_32FC2 for 8-bit images) is computed and stored,
+// the other half is its complex conjugate mirror.
+// threads: 0 = all cores, 1 = serial
+void calculateDFT(cv::Mat& scr, cv::Mat& dst, int threads = 0)
+{
+  // Reads the image, writes the half spectrum
+  PROFILE_SCOPE("calculateDFT", scr.total() * scr.elemSize() + scr.rows * (scr.cols / 2 + 1) * 2 * sizeof(float));
+  // Real-to-complex FFT, no zero imaginary plane needed
+  FFT::rfft2d(scr, dst, threads);
 }
 
 // IDFT
-cv::Mat reverseDTF(cv::Mat filteredFD)
+// `cols` is the width of the original image; by default an even width is assumed
+cv::Mat reverseDTF(cv::Mat filteredFD, int cols = -1, int threads = 0)
 {
+  if (cols < 0)
+  {
+    cols = 2 * (filteredFD.cols - 1);
+  }
+  PROFILE_SCOPE("reverseDTF", filteredFD.total() * filteredFD.elemSize() + filteredFD.rows * cols * sizeof(float));
   cv::Mat imgOut;
-  dft(filteredFD, imgOut, cv::DFT_INVERSE | cv::DFT_REAL_OUTPUT);
-  normalize(imgOut, imgOut, 0, 1, cv::NORM_MINMAX);
+  FFT::irfft2d(filteredFD, imgOut, cols, threads);
+  {
+    // Two passes over the image (min/max, then scaling)
+    PROFILE_SCOPE("normalize", 3 * imgOut.total() * imgOut.elemSize());
+    normalize(imgOut, imgOut, 0, 1, cv::NORM_MINMAX, CV_32F);
+  }
   return imgOut;
 }
 
+// Moves the zero frequency to (rows/2, cols/2). Works for odd sizes too:
+// output(i, j) = input((i + ceil(rows/2)) % rows, (j + ceil(cols/2)) % cols)
 void fftshift(const cv::Mat& input_img, cv::Mat& output_img)
 {
-  output_img = input_img.clone();
-  int cx = output_img.cols / 2;
-  int cy = output_img.rows / 2;
-  cv::Mat q1(output_img, cv::Rect(0, 0, cx, cy));
-  cv::Mat q2(output_img, cv::Rect(cx, 0, cx, cy));
-  cv::Mat q3(output_img, cv::Rect(0, cy, cx, cy));
-  cv::Mat q4(output_img, cv::Rect(cx, cy, cx, cy));
-
-  cv::Mat temp;
-  q1.copyTo(temp);
-  q4.copyTo(q1);
-  temp.copyTo(q4);
-  q2.copyTo(temp);
-  q3.copyTo(q2);
-  temp.copyTo(q3);
+  PROFILE_SCOPE("fftshift", 4 * input_img.total() * input_img.elemSize());
+  cv::Mat src = input_img.clone();
+  output_img.create(src.size(), src.type());
+  const int cy = src.rows / 2;
+  const int cx = src.cols / 2;
+  const int ry = src.rows - cy;
+  const int rx = src.cols - cx;
+
+  src(cv::Rect(rx, ry, cx, cy)).copyTo(output_img(cv::Rect(0, 0, cx, cy)));
+  src(cv::Rect(0, ry, rx, cy)).copyTo(output_img(cv::Rect(cx, 0, rx, cy)));
+  src(cv::Rect(rx, 0, cx, ry)).copyTo(output_img(cv::Rect(0, cy, cx, ry)));
+  src(cv::Rect(0, 0, rx, ry)).copyTo(output_img(cv::Rect(cx, cy, rx, ry)));
+}
+
+// Frequency-domain filters available through construct_H and filtering
+enum class FilterType
+{
+  IdealLp,
+  GaussianLp,
+  IdealHp,
+  GaussianHp,
+  BandPass,
+  Notch,
+  ButterworthLp,
+  ChebyshevLp
+};
+
+const char* filterName(FilterType type)
+{
+  switch (type)
+  {
+    case FilterType::IdealLp:
+      return "Ideal LP";
+    case FilterType::GaussianLp:
+      return "Gaussian LP";
+    case FilterType::IdealHp:
+      return "Ideal HP";
+    case FilterType::GaussianHp:
+      return "Gaussian HP";
+    case FilterType::BandPass:
+      return "BandPass";
+    case FilterType::Notch:
+      return "Notch";
+    case FilterType::ButterworthLp:
+      return "Butterworth LP";
+    default:
+      return "Chebyshev LP";
+  }
+}
+
+// Function to find the filter type by its name ("Ideal LP", ...); false if unknown.
+// Case and spaces are ignored, so "gaussianlp" works on the command line too.
+bool parseFilterType(const std::string& name, FilterType& type)
+{
+  auto simplify = [](const std::string& text)
+  {
+    std::string result;
+    for (char c : text)
+    {
+      if (c != ' ')
+      {
+        result += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      }
+    }
+    return result;
+  };
+
+  for (int i = 0; i <= static_cast<int>(FilterType::ChebyshevLp); i++)
+  {
+    if (simplify(name) == simplify(filterName(static_cast<FilterType>(i))))
+    {
+      type = static_cast<FilterType>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Parameters of one frequency-domain filter
+// (n is used by Butterworth and Chebyshev, epsilon by Chebyshev only)
+struct FilterSpec
+{
+  FilterType type = FilterType::IdealLp;
+  float D0 = 0.0f;
+  int n = 0;
+  float epsilon = 0.0f;
+};
+
+// Function to parse "type:D0[:n[:epsilon]]", e.g. "Butterworth LP:40:2"; false if malformed
+bool parseFilterSpec(const std::string& text, FilterSpec& spec)
+{
+  std::vector<std::string> fields;
+  std::stringstream stream(text);
+  std::string field;
+  while (std::getline(stream, field, ':'))
+  {
+    fields.push_back(field);
+  }
+  if (fields.size() < 2 || fields.size() > 4 || !parseFilterType(fields[0], spec.type))
+  {
+    return false;
+  }
+  try
+  {
+    spec.D0 = std::stof(fields[1]);
+    spec.n = fields.size() > 2 ? std::stoi(fields[2]) : 0;
+    spec.epsilon = fields.size() > 3 ? std::stof(fields[3]) : 0.0f;
+  }
+  catch (const std::exception&)
+  {
+    return false;
+  }
+  return true;
+}
+
+// Function to call fn with the radial profile of a filter spec.
+// This is the only place where the filter type is dispatched at run time;
+// everything downstream is instantiated per profile.
+template <typename F>
+void withProfile(const FilterSpec& spec, F&& fn)
+{
+  const float D1 = spec.D0 * 0.75f;
+  const float D2 = spec.D0 * 1.25f;
+  switch (spec.type)
+  {
+    case FilterType::IdealLp:
+      fn(IdealLpProfile{spec.D0});
+      break;
+    case FilterType::GaussianLp:
+      fn(GaussianLpProfile{spec.D0});
+      break;
+    case FilterType::IdealHp:
+      fn(IdealHpProfile{spec.D0});
+      break;
+    case FilterType::GaussianHp:
+      fn(GaussianHpProfile{spec.D0});
+      break;
+    case FilterType::BandPass:
+      fn(BandPassProfile{D1, D2});
+      break;
+    case FilterType::Notch:
+      fn(NotchProfile{D1, D2});
+      break;
+    case FilterType::ButterworthLp:
+      fn(ButterworthLpProfile{spec.D0, spec.n});
+      break;
+    case FilterType::ChebyshevLp:
+      fn(ChebyshevLpProfile{spec.D0, spec.epsilon, spec.n});
+      break;
+  }
+}
+
+// Function to fill H with the centered transfer function of one filter
+void fillH(cv::Mat& H, const FilterSpec& spec)
+{
+  if (spec.type == FilterType::GaussianLp || spec.type == FilterType::GaussianHp)
+  {
+    separableGaussianFilter(H, spec.D0, spec.type == FilterType::GaussianHp);
+    return;
+  }
+  withProfile(spec, [&](const auto& profile) { radialFilter(H, profile); });
 }
 
 // Frequency domain filter matrix as "H" (common in literature)
-// Default n and epsilon allow to use function without these values
-cv::Mat construct_H(cv::Mat& scr, std::string type, float D0, int n = 0, float epsilon = 0.0f)
+cv::Mat construct_H(cv::Mat& scr, const FilterSpec& spec)
+{
+  PROFILE_SCOPE("construct_H", scr.total() * sizeof(float));
+  cv::Mat H(scr.size(), CV_32F);
+  fillH(H, spec);
+  return H;
+}
+
+// Combined transfer function of an ordered chain of filters (their product)
+cv::Mat construct_H(cv::Mat& scr, const std::vector<FilterSpec>& chain)
 {
-  // Matrix filled with 1's (all-pass filter)
+  PROFILE_SCOPE("construct_H", (3 * chain.size() + 1) * scr.total() * sizeof(float));
   cv::Mat H(scr.size(), CV_32F, cv::Scalar(1));
-  float D = 0;
-  if (type == "Ideal LP")
+  cv::Mat next(scr.size(), CV_32F);
+  for (const FilterSpec& spec : chain)
+  {
+    fillH(next, spec);
+    H = H.mul(next);
+  }
+  return H;
+}
+
+// Default n and epsilon allow to use function without these values.
+// An unknown type gives an all-pass filter.
+cv::Mat construct_H(cv::Mat& scr, std::string type, float D0, int n = 0, float epsilon = 0.0f)
+{
+  FilterSpec spec{FilterType::IdealLp, D0, n, epsilon};
+  if (!parseFilterType(type, spec.type))
+  {
+    // Matrix filled with 1's (all-pass filter)
+    return cv::Mat(scr.size(), CV_32F, cv::Scalar(1));
+  }
+  return construct_H(scr, spec);
+}
+
+template <typename T>
+void multiplyHalfSpectrum(const cv::Mat& scr, cv::Mat& dst, const cv::Mat& H)
+{
+  const int cy = H.rows / 2;
+  const int cx = H.cols / 2;
+  for (int u = 0; u < scr.rows; u++)
   {
-    idealLpFilter(scr, H, D, D0);
+    const float* h = H.ptr<float>((u + cy) % H.rows);
+    const cv::Vec<T, 2>* in = scr.ptr<cv::Vec<T, 2>>(u);
+    cv::Vec<T, 2>* out = dst.ptr<cv::Vec<T, 2>>(u);
+    for (int v = 0; v < scr.cols; v++)
+    {
+      const T gain = h[(v + cx) % H.cols];
+      out[v] = cv::Vec<T, 2>(in[v][0] * gain, in[v][1] * gain);
+    }
   }
-  else if (type == "Gaussian LP")
+}
+
+// Multiplies the half spectrum (CV_32FC2 or CV_64FC2) by the centered,
+// full-size filter H. The spectrum is unshifted (DC at (0, 0)), so H is
+// sampled at the quadrant-swapped position instead of running fftshift on a copy of H.
+void filtering(cv::Mat& scr, cv::Mat& dst, const cv::Mat& H)
+{
+  CV_Assert((scr.type() == CV_32FC2 || scr.type() == CV_64FC2) && H.type() == CV_32F && scr.rows == H.rows &&
+            scr.cols == H.cols / 2 + 1);
+  PROFILE_SCOPE("filtering", 2 * scr.total() * scr.elemSize() + scr.total() * sizeof(float));
+  dst.create(scr.size(), scr.type());
+  if (scr.type() == CV_32FC2)
+  {
+    multiplyHalfSpectrum<float>(scr, dst, H);
+  }
+  else
+  {
+    multiplyHalfSpectrum<double>(scr, dst, H);
+  }
+}
+
+// Row evaluator of any filter profile, for chains whose length is only known at run time
+typedef std::variant<RadialEvaluator<IdealLpProfile>, RadialEvaluator<GaussianLpProfile>,
+                     RadialEvaluator<IdealHpProfile>, RadialEvaluator<GaussianHpProfile>,
+                     RadialEvaluator<BandPassProfile>, RadialEvaluator<NotchProfile>,
+                     RadialEvaluator<ButterworthLpProfile>, RadialEvaluator<ChebyshevLpProfile>>
+    AnyRadialEvaluator;
+
+// Per-thread buffer `slot` of at least n floats, kept between calls so rows
+// can be processed without allocating. Only for use inside one row loop:
+// nothing that runs other pool tasks may happen while it is in use.
+float* rowScratch(int slot, int n)
+{
+  thread_local std::vector<float> buffers[3];
+  if (static_cast<int>(buffers[slot].size()) < n)
   {
-    gaussianLpFilter(scr, H, D, D0);
+    buffers[slot].resize(n);
   }
-  else if (type == "Ideal HP")
+  return buffers[slot].data();
+}
+
+// Row gain of an ordered chain of filters: the product of their profiles
+class ChainGain
+{
+public:
+  // maxD: largest distance that will be looked up
+  ChainGain(const std::vector<FilterSpec>& chain, double maxD)
   {
-    idealHpFilter(scr, H, D, D0);
+    evaluators_.reserve(chain.size());
+    for (const FilterSpec& spec : chain)
+    {
+      withProfile(spec,
+                  [&](const auto& profile)
+                  {
+                    typedef RadialEvaluator<std::decay_t<decltype(profile)>> Evaluator;
+                    evaluators_.emplace_back(std::in_place_type<Evaluator>, profile, maxD);
+                  });
+    }
   }
-  else if (type == "Gaussian HP")
+
+  // gain[i] = product of H(D[i]) over the chain for n distances (1 for an
+  // empty chain); next is scratch of n floats
+  void operator()(const float* D, float* gain, float* next, int n) const
   {
-    gaussianHpFilter(scr, H, D, D0);
+    std::fill(gain, gain + n, 1.0f);
+    for (std::size_t f = 0; f < evaluators_.size(); f++)
+    {
+      std::visit([&](const auto& evaluate) { evaluate(D, f == 0 ? gain : next, n); }, evaluators_[f]);
+      if (f == 0)
+      {
+        continue;
+      }
+      for (int i = 0; i < n; i++)
+      {
+        gain[i] *= next[i];
+      }
+    }
   }
-  else if (type == "BandPass")
+
+private:
+  std::vector<AnyRadialEvaluator> evaluators_;
+};
+
+// Multiplies a half spectrum by a radial gain in one pass, without building
+// H. gain(D, out, next, n) writes the gain of n distances (next is scratch).
+// The spectrum is unshifted, so the centered distance of bin (u, v) is taken
+// from the quadrant-swapped position: |du| = min(u, rows - u) and |dv| = v
+// (only v <= cols/2 is stored). This gives exactly the distance construct_H
+// uses at the matching position of the centered H.
+template <typename T, typename Gain>
+void filterHalfSpectrum(const cv::Mat& scr, cv::Mat& dst, const Gain& gain, int threads)
+{
+  const int rows = scr.rows;
+  const int halfCols = scr.cols;
+
+  threading::defaultPool().parallelFor(
+      rows,
+      [&](int begin, int end, int)
+      {
+        float* D = rowScratch(0, halfCols);
+        float* g = rowScratch(1, halfCols);
+        float* next = rowScratch(2, halfCols);
+        for (int u = begin; u < end; u++)
+        {
+          const int du = std::min(u, rows - u);
+          for (int v = 0; v < halfCols; v++)
+          {
+            D[v] = std::sqrt(static_cast<float>(du * du + v * v));
+          }
+          gain(D, g, next, halfCols);
+
+          // Interleaved (re, im) pairs, so dst may be the same matrix as scr
+          const T* in = scr.ptr<T>(u);
+          T* out = dst.ptr<T>(u);
+          for (int v = 0; v < halfCols; v++)
+          {
+            out[2 * v] = in[2 * v] * g[v];
+            out[2 * v + 1] = in[2 * v + 1] * g[v];
+          }
+        }
+      },
+      threads);
+}
+
+// Function to run filterHalfSpectrum for the element type of scr
+template <typename Gain>
+void applyRadialGain(const cv::Mat& scr, cv::Mat& dst, const Gain& gain, int threads)
+{
+  if (scr.type() == CV_32FC2)
   {
-    bandPassFilter(scr, H, D, D0);
+    filterHalfSpectrum<float>(scr, dst, gain, threads);
   }
-  else if (type == "Notch")
+  else
   {
-    notchFilter(scr, H, D, D0);
+    filterHalfSpectrum<double>(scr, dst, gain, threads);
   }
-  else if (type == "Butterworth LP")
+}
+
+// Function to reduce a chain to a single Gaussian: a product of Gaussian low
+// passes is the Gaussian low pass with 1/D0^2 = sum of 1/D0i^2, a lone
+// Gaussian high pass stays one. False for any other chain.
+bool gaussianChain(const std::vector<FilterSpec>& chain, float& D0, bool& highPass)
+{
+  if (chain.size() == 1 && chain[0].type == FilterType::GaussianHp)
   {
-    butterworthLpFilter(scr, H, D, D0, n);
+    D0 = chain[0].D0;
+    highPass = true;
+    return true;
   }
-  else if (type == "Chebyshev LP")
+  double inverseSquares = 0.0;
+  for (const FilterSpec& spec : chain)
   {
-    chebyshevLpFilter(scr, H, D, D0, epsilon, n);
+    if (spec.type != FilterType::GaussianLp)
+    {
+      return false;
+    }
+    inverseSquares += 1.0 / (static_cast<double>(spec.D0) * spec.D0);
   }
-  return H;
+  D0 = static_cast<float>(1.0 / std::sqrt(inverseSquares));
+  highPass = false;
+  return !chain.empty();
+}
+
+// Multiplies a half spectrum by a Gaussian low (or high) pass built from a
+// row gain exp(-du^2 / (2 D0^2)) and a column gain exp(-dv^2 / (2 D0^2)),
+// with du and dv as in filterHalfSpectrum: one multiply per bin, no sqrt.
+template <typename T>
+void filterSeparableGaussian(const cv::Mat& scr, cv::Mat& dst, float D0, bool highPass, int threads)
+{
+  const int rows = scr.rows;
+  const int halfCols = scr.cols;
+
+  threading::defaultPool().parallelFor(
+      rows,
+      [&](int begin, int end, int)
+      {
+        // Column gain per chunk: halfCols exps, no shared buffer to allocate
+        float* columnGain = rowScratch(0, halfCols);
+        float* gain = rowScratch(1, halfCols);
+        for (int v = 0; v < halfCols; v++)
+        {
+          columnGain[v] = static_cast<float>(std::exp(-static_cast<double>(v) * v / (2.0 * D0 * D0)));
+        }
+        for (int u = begin; u < end; u++)
+        {
+          const double du = std::min(u, rows - u);
+          const float rowGain = static_cast<float>(std::exp(-du * du / (2.0 * D0 * D0)));
+          for (int v = 0; v < halfCols; v++)
+          {
+            gain[v] = highPass ? 1 - rowGain * columnGain[v] : rowGain * columnGain[v];
+          }
+
+          const T* in = scr.ptr<T>(u);
+          T* out = dst.ptr<T>(u);
+          for (int v = 0; v < halfCols; v++)
+          {
+            out[2 * v] = in[2 * v] * gain[v];
+            out[2 * v + 1] = in[2 * v + 1] * gain[v];
+          }
+        }
+      },
+      threads);
+}
+
+// Applies an ordered chain of filters to a half spectrum (CV_32FC2 or
+// CV_64FC2) as one combined multiply, so any chain costs a single pass
+// between one forward and one inverse FFT. H is never materialized; works
+// in place when dst is scr. An empty chain is the all-pass filter.
+// `cols` is the width of the original image (by default an even width is assumed).
+void filtering(const cv::Mat& scr, cv::Mat& dst, const std::vector<FilterSpec>& chain, int cols = -1,
+               int threads = 0)
+{
+  CV_Assert(scr.type() == CV_32FC2 || scr.type() == CV_64FC2);
+  if (cols < 0)
+  {
+    cols = 2 * (scr.cols - 1);
+  }
+  CV_Assert(scr.cols == cols / 2 + 1);
+  PROFILE_SCOPE("filtering", 2 * scr.total() * scr.elemSize());
+  dst.create(scr.size(), scr.type());
+
+  float D0 = 0.0f;
+  bool highPass = false;
+  if (gaussianChain(chain, D0, highPass))
+  {
+    if (scr.type() == CV_32FC2)
+    {
+      filterSeparableGaussian<float>(scr, dst, D0, highPass, threads);
+    }
+    else
+    {
+      filterSeparableGaussian<double>(scr, dst, D0, highPass, threads);
+    }
+    return;
+  }
+
+  const double maxD = maxRadialDistance(scr.rows, cols);
+  if (chain.size() == 1)
+  {
+    // One filter: instantiated for its profile, nothing type-erased
+    withProfile(chain[0],
+                [&](const auto& profile)
+                {
+                  const RadialEvaluator<std::decay_t<decltype(profile)>> evaluate(profile, maxD);
+                  applyRadialGain(
+                      scr, dst, [&](const float* D, float* gain, float*, int n) { evaluate(D, gain, n); }, threads);
+                });
+    return;
+  }
+  applyRadialGain(scr, dst, ChainGain(chain, maxD), threads);
 }
 
-void filtering(cv::Mat& scr, cv::Mat& dst, cv::Mat& H)
+// Applies a single filter to a half spectrum, see above
+void filtering(const cv::Mat& scr, cv::Mat& dst, const FilterSpec& spec, int cols = -1, int threads = 0)
 {
-  fftshift(H, H);
-  cv::Mat planesH[] = {cv::Mat_<float>(H.clone()), cv::Mat_<float>(H.clone())};
+  filtering(scr, dst, std::vector<FilterSpec>{spec}, cols, threads);
+}
+
+// Rough operation counts used to pick the route in filterImage: per sample
+// of a recursive pass (two 3-tap recursions and the copies), and per point
+// and log2(points) of the forward plus inverse FFT
+const double kIirOpsPerSample = 16.0;
+const double kFftOpsPerPoint = 5.0;
+
+// Filters an image with a chain of filters and returns what calculateDFT,
+// filtering and reverseDTF give (CV_32F normalized to [0, 1]).
+// Gaussian chains run as a recursive blur in the image domain instead when
+// that is estimated cheaper (see iir_gaussian.hpp): no FFT and a cost that
+// does not depend on D0. A D0 in frequency bins is a blur of
+// sigma = size / (2 pi D0) pixels; the high pass is the image minus the blur.
+cv::Mat filterImage(const cv::Mat& image, const std::vector<FilterSpec>& chain, int threads = 0)
+{
+  float D0 = 0.0f;
+  bool highPass = false;
+  if (gaussianChain(chain, D0, highPass) && D0 > 0)
+  {
+    const double sigmaY = image.rows / (2 * CV_PI * D0);
+    const double sigmaX = image.cols / (2 * CV_PI * D0);
+    const double pixels = static_cast<double>(image.total());
+    const double iirOps = kIirOpsPerSample * (image.rows * (image.cols + 2.0 * iir::padding(sigmaX)) +
+                                              image.cols * (image.rows + 2.0 * iir::padding(sigmaY)));
+    const double fftOps = kFftOpsPerPoint * pixels * std::log2(pixels);
+    if (std::min(sigmaX, sigmaY) >= iir::kMinSigma && iirOps < fftOps)
+    {
+      PROFILE_SCOPE("gaussianIir", 5 * image.total() * sizeof(float));
+      cv::Mat input, imgOut;
+      image.convertTo(input, CV_32F);
+      iir::gaussianBlur(input, imgOut, sigmaX, sigmaY, threads);
+      if (highPass)
+      {
+        imgOut = input - imgOut;
+      }
+      normalize(imgOut, imgOut, 0, 1, cv::NORM_MINMAX, CV_32F);
+      return imgOut;
+    }
+  }
 
-  cv::Mat planes_dft[] = {scr, cv::Mat::zeros(scr.size(), CV_32F)};
-  split(scr, planes_dft);
+  cv::Mat input = image;
+  cv::Mat spectrum;
+  calculateDFT(input, spectrum, threads);
+  filtering(spectrum, spectrum, chain, image.cols, threads);
+  return reverseDTF(spectrum, image.cols, threads);
+}
 
-  cv::Mat planes_out[] = {cv::Mat::zeros(scr.size(), CV_32F), cv::Mat::zeros(scr.size(), CV_32F)};
-  planes_out[0] = planesH[0].mul(planes_dft[0]);
-  planes_out[1] = planesH[1].mul(planes_dft[1]);
+template <typename T>
+void halfSpectrumMagnitude(const cv::Mat& halfSpectrum, cv::Mat& mag)
+{
+  const int rows = halfSpectrum.rows;
+  const int cols = mag.cols;
+  for (int u = 0; u < rows; u++)
+  {
+    float* out = mag.ptr<float>(u);
+    for (int v = 0; v < cols; v++)
+    {
+      const bool mirrored = v >= halfSpectrum.cols;
+      const cv::Vec<T, 2>& x = mirrored ? halfSpectrum.at<cv::Vec<T, 2>>((rows - u) % rows, cols - v)
+                                        : halfSpectrum.at<cv::Vec<T, 2>>(u, v);
+      out[v] = static_cast<float>(std::sqrt(x[0] * x[0] + x[1] * x[1]));
+    }
+  }
+}
 
-  merge(planes_out, 2, dst);
+// Rebuilds the full-size magnitude from a half spectrum using the
+// Hermitian symmetry |X(u, v)| == |X(-u, -v)|
+cv::Mat halfSpectrumMagnitude(const cv::Mat& halfSpectrum, int cols)
+{
+  cv::Mat mag(halfSpectrum.rows, cols, CV_32F);
+  if (halfSpectrum.type() == CV_32FC2)
+  {
+    halfSpectrumMagnitude<float>(halfSpectrum, mag);
+  }
+  else
+  {
+    halfSpectrumMagnitude<double>(halfSpectrum, mag);
+  }
+  return mag;
 }
 
-void show_dft_effect(cv::Mat image)
+void show_dft_effect(cv::Mat image, int cols = -1)
 {
-  // Expanding input image to optimal size
-  cv::Mat padded;
-  int m = cv::getOptimalDFTSize(image.rows);
-  int n = cv::getOptimalDFTSize(image.cols);
-  copyMakeBorder(image, padded, 0, m - image.rows, 0, n - image.cols, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+  if (cols < 0)
+  {
+    cols = 2 * (image.cols - 1);
+  }
   /*
     The result of the transformation is complex numbers.
     Displaying this is possible via a magnitude.
         */
-  cv::Mat real, imaginary;
-  cv::Mat planes[] = {real, imaginary};
-
-  split(padded, planes);
-  cv::Mat mag_image;
-  magnitude(planes[0], planes[1], mag_image);
+  // The FFT handles any size, so the spectrum is shown as is (no padding)
+  cv::Mat mag_image = halfSpectrumMagnitude(image, cols);
 
   // Switch to a logarithmic scale
   mag_image += cv::Scalar::all(1);
   log(mag_image, mag_image);
-  mag_image = mag_image(cv::Rect(0, 0, mag_image.cols & -2, mag_image.rows & -2));
 
   cv::Mat shifted_DFT;
   fftshift(mag_image, shifted_DFT);
@@ -206,11 +702,14 @@ void show_dft_effect(cv::Mat image)
 ////////////////////              BUILT-INS             ////////////////////
 ////////////////////////////////////////////////////////////////////////////
 
+// The kernel filters below go through convolution::filter2D, which gives the
+// cv::filter2D result by the cheapest of the direct, separable and FFT routes
+
 // Function to apply identity filter using a specified kernel
 cv::Mat applyIdentityFilter(const cv::Mat& inputImage, const cv::Mat& kernel)
 {
   cv::Mat filteredImage;
-  cv::filter2D(inputImage, filteredImage, -1, kernel, cv::Point(-1, -1), 0, 4);
+  convolution::filter2D(inputImage, filteredImage, kernel, cv::BORDER_DEFAULT);
   return filteredImage;
 }
 
@@ -218,7 +717,7 @@ cv::Mat applyIdentityFilter(const cv::Mat& inputImage, const cv::Mat& kernel)
 cv::Mat applyBlurFilter(const cv::Mat& inputImage, const cv::Mat& kernel)
 {
   cv::Mat filteredImage;
-  cv::filter2D(inputImage, filteredImage, -1, kernel, cv::Point(-1, -1), 0, 4);
+  convolution::filter2D(inputImage, filteredImage, kernel, cv::BORDER_DEFAULT);
   return filteredImage;
 }
 
@@ -237,7 +736,7 @@ cv::Mat applyGaussianBlur(const cv::Mat& image, int kernelSize)
 cv::Mat applySharpening(const cv::Mat& image, const cv::Mat& kernel)
 {
   cv::Mat sharpImage;
-  cv::filter2D(image, sharpImage, -1, kernel, cv::Point(-1, -1), 0, cv::BORDER_DEFAULT);
+  convolution::filter2D(image, sharpImage, kernel, cv::BORDER_DEFAULT);
   return sharpImage;
 }
 
@@ -1,8 +1,16 @@
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <opencv2/highgui.hpp>
 
+#include "batch.hpp"
+#include "codec.hpp"
+#include "filter_cache.hpp"
 #include "helpers.hpp"
 #include "image_processing.hpp"
+#include "streaming.hpp"
+#include "sweep.hpp"
+#include "tiled.hpp"
 #include "wavelets.hpp"
 
 /*
@@ -29,68 +37,87 @@ int main(int argc, char** argv) {
   }
 */
 
+// Reads the parameters of filter `choice` (1-8) from stdin; false for an invalid choice
+bool readFilterSpec(int choice, image_processing::FilterSpec& spec)
+{
+  if (choice < 1 || choice > 8)
+  {
+    return false;
+  }
+  spec = {static_cast<image_processing::FilterType>(choice - 1)};
+  const bool usesOrder = spec.type == image_processing::FilterType::ButterworthLp ||
+                         spec.type == image_processing::FilterType::ChebyshevLp;
+
+  std::cout << "Enter the desired D0 (0-100 makes sense):\n";
+  std::cin >> spec.D0;
+  if (usesOrder)
+  {
+    std::cout << "Enter the order n (Typical values are 1-5):\n";
+    std::cin >> spec.n;
+  }
+  if (spec.type == image_processing::FilterType::ChebyshevLp)
+  {
+    std::cout << "Enter the ripple factor epsilon (Typical values are 0.1-0.5):\n";
+    std::cin >> spec.epsilon;
+  }
+  return true;
+}
+
 void menuLoop(cv::Mat& imgIn, cv::Mat& DFT_image)
 {
   while (true)
   {
-    cv::Mat H;
+    std::vector<image_processing::FilterSpec> chain;
     int choice;
-    float D0;
-    int n;
-    float epsilon;
     helpers::menuPrompts();
     std::cin >> choice;
     if (choice == 0)
     {
       break;
     }
-    std::cout << "Enter the desired D0 (0-100 makes sense):\n";
-    std::cin >> D0;
 
-    switch (choice)
+    if (choice == 9) // Chain of filters, applied as one combined filter
+    {
+      int count;
+      std::cout << "How many filters in the chain?\n";
+      std::cin >> count;
+      for (int i = 0; i < count; i++)
+      {
+        int type;
+        std::cout << "Filter " << i + 1 << " type (1-8):\n";
+        std::cin >> type;
+        image_processing::FilterSpec spec;
+        if (!readFilterSpec(type, spec))
+        {
+          std::cerr << "Invalid choice\n";
+          break;
+        }
+        chain.push_back(spec);
+      }
+      if (static_cast<int>(chain.size()) != count)
+      {
+        continue;
+      }
+    }
+    else
     {
-      case 1:
-        H = image_processing::construct_H(imgIn, "Ideal LP", static_cast<float>(D0));
-        break;
-      case 2:
-        H = image_processing::construct_H(imgIn, "Gaussian LP", static_cast<float>(D0));
-        break;
-      case 3:
-        H = image_processing::construct_H(imgIn, "Ideal HP", static_cast<float>(D0));
-        break;
-      case 4:
-        H = image_processing::construct_H(imgIn, "Gaussian HP", static_cast<float>(D0));
-        break;
-      case 5:
-        H = image_processing::construct_H(imgIn, "BandPass", static_cast<float>(D0));
-        break;
-      case 6:
-        H = image_processing::construct_H(imgIn, "Notch", static_cast<float>(D0));
-        break;
-      case 7: // Butterworth LP
-        std::cout << "Enter the order n (Typical values are 1-5):\n";
-        std::cin >> n;
-        H = image_processing::construct_H(imgIn, "Butterworth LP", static_cast<float>(D0), n);
-        break;
-      case 8: // Chebyshev LP
-        std::cout << "Enter the order n (Typical values are 1-5):\n";
-        std::cin >> n;
-        std::cout << "Enter the ripple factor epsilon (Typical values are 0.1-0.5):\n";
-        std::cin >> epsilon;
-        H = image_processing::construct_H(imgIn, "Chebyshev LP", static_cast<float>(D0), n, epsilon);
-        break;
-      default:
+      image_processing::FilterSpec spec;
+      if (!readFilterSpec(choice, spec))
+      {
         std::cerr << "Invalid choice\n";
         continue;
+      }
+      chain.push_back(spec);
     }
 
-    // Apply filtering and display the frequency domain
+    // Apply filtering (H is reused when the same filters are applied again) and display the frequency domain
+    const std::shared_ptr<const cv::Mat> H = image_processing::filterCache().get(imgIn, chain);
     cv::Mat filtered_img;
-    image_processing::filtering(DFT_image, filtered_img, H);
-    image_processing::show_dft_effect(filtered_img);
+    image_processing::filtering(DFT_image, filtered_img, *H);
+    image_processing::show_dft_effect(filtered_img, imgIn.cols);
 
     // Doing a reversed DFT to visualize final effect
-    cv::Mat imgOut = image_processing::reverseDTF(filtered_img);
+    cv::Mat imgOut = image_processing::reverseDTF(filtered_img, imgIn.cols);
     imshow("Filtered Image", imgOut);
 
     cv::normalize(imgOut, imgOut, 0, 255, cv::NORM_MINMAX);
@@ -103,8 +130,30 @@ void menuLoop(cv::Mat& imgIn, cv::Mat& DFT_image)
   }
 }
 
-int main()
+int main(int argc, char** argv)
 {
+  // Any argument selects a headless mode: the codec with --encode/--decode
+  // (see codec.hpp), a parameter sweep with --sweep (see sweep.hpp), out-of-core
+  // filtering with --tiled (see tiled.hpp), streaming with --video (see
+  // streaming.hpp), batch otherwise (see batch.hpp)
+  if (argc > 1 && (std::string(argv[1]) == "--encode" || std::string(argv[1]) == "--decode"))
+  {
+    return codec::main(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--sweep")
+  {
+    return sweep::main(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--tiled")
+  {
+    return tiled::main(argc, argv);
+  }
+  if (argc > 1)
+  {
+    auto isVideo = [](const char* arg) { return std::string(arg) == "--video"; };
+    return std::any_of(argv + 1, argv + argc, isVideo) ? streaming::main(argc, argv) : batch::main(argc, argv);
+  }
+
   cv::Mat imgIn;
   cv::Mat DFT_image;
 
@@ -122,9 +171,10 @@ int main()
   cv::waitKey();
 
   image_processing::calculateDFT(imgIn, DFT_image);
-  image_processing::show_dft_effect(DFT_image);
+  image_processing::show_dft_effect(DFT_image, imgIn.cols);
 
   menuLoop(imgIn, DFT_image);
+  image_processing::filterCache().printStats();
 
   return 0;
 }
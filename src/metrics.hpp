@@ -0,0 +1,289 @@
+/*
+  *metrics.hpp
+    Image quality metrics: MSE, PSNR, SSIM, and the energy compaction of a
+    set of transform coefficients
+  *Inputs are single-channel cv::Mat of any depth (converted to float when
+   they are not CV_32F); PSNR and SSIM take the peak value, 255 by default.
+  *Every metric ends in a sum over the pixels, computed by reduce(): the
+   per-element term is a small functor written once for any vector type,
+   summed in float vector lanes over short chunks and in double across
+   chunks, with the kernel picked for the running CPU.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <vector>
+
+#include "simd.hpp"
+
+namespace metrics
+{
+
+// Elements summed in float lanes before the partial sum goes to double
+const int kReduceChunk = 1024;
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+template <typename V>
+SIMD_INLINE double horizontalSum(const V& v)
+{
+  constexpr int L = simd::lanes<V, float>();
+  float lanes[L];
+  simd::store(lanes, v);
+  double sum = 0.0;
+  for (int i = 0; i < L; i++)
+  {
+    sum += lanes[i];
+  }
+  return sum;
+}
+
+// Function to sum op.term<V>(i) over [begin, n) in steps of the V width;
+// returns the first element not summed
+template <typename V, typename Op>
+SIMD_INLINE int reduceLanes(const Op& op, int begin, int n, double& sum)
+{
+  constexpr int L = simd::lanes<V, float>();
+  int i = begin;
+  while (i + L <= n)
+  {
+    const int end = std::min(n, i + kReduceChunk);
+    V acc = V{} + 0.0f;
+    for (; i + L <= end; i += L)
+    {
+      acc += op.template term<V>(i);
+    }
+    sum += horizontalSum(acc);
+  }
+  return i;
+}
+
+template <typename V, typename Op>
+SIMD_INLINE double reduce(const Op& op, int n)
+{
+  double sum = 0.0;
+  const int i = reduceLanes<V>(op, 0, n, sum);
+  reduceLanes<float>(op, i, n, sum);
+  return sum;
+}
+
+// Per-instruction-set instantiations of reduce
+template <typename Op>
+double reduceScalar(const Op& op, int n)
+{
+  return reduce<float>(op, n);
+}
+
+#if defined(SIMD_X86)
+template <typename Op>
+SIMD_TARGET("sse2") double reduceSse2(const Op& op, int n)
+{
+  return reduce<simd::Vector<float, 16>::type>(op, n);
+}
+
+template <typename Op>
+SIMD_TARGET("avx2,fma") double reduceAvx2(const Op& op, int n)
+{
+  return reduce<simd::Vector<float, 32>::type>(op, n);
+}
+#endif
+
+#if defined(SIMD_NEON)
+template <typename Op>
+double reduceNeon(const Op& op, int n)
+{
+  return reduce<simd::Vector<float, 16>::type>(op, n);
+}
+#endif
+
+// (a - b)^2
+struct SquaredDifference
+{
+  const float* a;
+  const float* b;
+
+  template <typename V>
+  SIMD_INLINE V term(int i) const
+  {
+    const V d = simd::load<V>(a + i) - simd::load<V>(b + i);
+    return d * d;
+  }
+};
+
+// a
+struct Value
+{
+  const float* a;
+
+  template <typename V>
+  SIMD_INLINE V term(int i) const
+  {
+    return simd::load<V>(a + i);
+  }
+};
+
+// a^2
+struct Square
+{
+  const float* a;
+
+  template <typename V>
+  SIMD_INLINE V term(int i) const
+  {
+    const V v = simd::load<V>(a + i);
+    return v * v;
+  }
+};
+
+// SSIM map from the local means (mu), second moments (xx, yy) and cross moment (xy)
+struct SsimMap
+{
+  const float* muX;
+  const float* muY;
+  const float* xx;
+  const float* yy;
+  const float* xy;
+  float c1;
+  float c2;
+
+  template <typename V>
+  SIMD_INLINE V term(int i) const
+  {
+    const V mx = simd::load<V>(muX + i);
+    const V my = simd::load<V>(muY + i);
+    const V mxy = mx * my;
+    const V mx2 = mx * mx;
+    const V my2 = my * my;
+    const V sxy = simd::load<V>(xy + i) - mxy;
+    const V sx2 = simd::load<V>(xx + i) - mx2;
+    const V sy2 = simd::load<V>(yy + i) - my2;
+    return ((2.0f * mxy + c1) * (2.0f * sxy + c2)) / ((mx2 + my2 + c1) * (sx2 + sy2 + c2));
+  }
+};
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+// Function to sum op.term over n elements with the best kernel of the CPU
+template <typename Op>
+double reduce(const Op& op, int n)
+{
+  switch (simd::bestIsa())
+  {
+#if defined(SIMD_X86)
+    case simd::Isa::AVX2:
+      return reduceAvx2(op, n);
+    case simd::Isa::SSE2:
+      return reduceSse2(op, n);
+#endif
+#if defined(SIMD_NEON)
+    case simd::Isa::NEON:
+      return reduceNeon(op, n);
+#endif
+    default:
+      return reduceScalar(op, n);
+  }
+}
+
+// Function to get a single-channel image as CV_32F (shared, not copied, when it already is)
+cv::Mat asFloat(const cv::Mat& image)
+{
+  CV_Assert(image.channels() == 1);
+  if (image.type() == CV_32FC1)
+  {
+    return image;
+  }
+  cv::Mat converted;
+  image.convertTo(converted, CV_32F);
+  return converted;
+}
+
+// Mean squared error between two images of the same size
+double mse(const cv::Mat& a, const cv::Mat& b)
+{
+  CV_Assert(a.size() == b.size());
+  const cv::Mat fa = asFloat(a);
+  const cv::Mat fb = asFloat(b);
+  double sum = 0.0;
+  for (int y = 0; y < fa.rows; y++)
+  {
+    sum += reduce(SquaredDifference{fa.ptr<float>(y), fb.ptr<float>(y)}, fa.cols);
+  }
+  return sum / std::max<double>(1.0, fa.total());
+}
+
+// Peak signal-to-noise ratio in dB (infinite for identical images)
+double psnr(const cv::Mat& a, const cv::Mat& b, double peak = 255.0)
+{
+  const double error = mse(a, b);
+  return error == 0.0 ? std::numeric_limits<double>::infinity() : 10.0 * std::log10(peak * peak / error);
+}
+
+// Mean structural similarity (Wang et al. 2004): 11x11 Gaussian window with
+// sigma 1.5, K1 = 0.01, K2 = 0.03
+double ssim(const cv::Mat& a, const cv::Mat& b, double peak = 255.0)
+{
+  CV_Assert(a.size() == b.size());
+  const cv::Mat x = asFloat(a);
+  const cv::Mat y = asFloat(b);
+  const cv::Size window(11, 11);
+  const double sigma = 1.5;
+
+  cv::Mat muX, muY, xx, yy, xy;
+  cv::GaussianBlur(x, muX, window, sigma);
+  cv::GaussianBlur(y, muY, window, sigma);
+  cv::GaussianBlur(x.mul(x), xx, window, sigma);
+  cv::GaussianBlur(y.mul(y), yy, window, sigma);
+  cv::GaussianBlur(x.mul(y), xy, window, sigma);
+
+  const float c1 = static_cast<float>((0.01 * peak) * (0.01 * peak));
+  const float c2 = static_cast<float>((0.03 * peak) * (0.03 * peak));
+  double sum = 0.0;
+  for (int r = 0; r < x.rows; r++)
+  {
+    sum += reduce(SsimMap{muX.ptr<float>(r), muY.ptr<float>(r), xx.ptr<float>(r), yy.ptr<float>(r),
+                          xy.ptr<float>(r), c1, c2},
+                  x.cols);
+  }
+  return sum / std::max<double>(1.0, x.total());
+}
+
+// Energy compaction: share of the total energy (sum of squares) held by the
+// largest `fraction` of the coefficients, in [0, 1]
+double energyCompaction(const cv::Mat& coefficients, double fraction = 0.05)
+{
+  const cv::Mat c = asFloat(coefficients);
+  std::vector<float> energies;
+  energies.reserve(c.total());
+  double total = 0.0;
+  for (int y = 0; y < c.rows; y++)
+  {
+    const float* row = c.ptr<float>(y);
+    total += reduce(Square{row}, c.cols);
+    for (int x = 0; x < c.cols; x++)
+    {
+      energies.push_back(row[x] * row[x]);
+    }
+  }
+  if (total == 0.0 || energies.empty())
+  {
+    return 1.0;
+  }
+
+  const std::size_t count = std::clamp<std::size_t>(std::ceil(fraction * energies.size()), 1, energies.size());
+  std::nth_element(energies.begin(), energies.begin() + (count - 1), energies.end(), std::greater<float>());
+  const double top = reduce(Value{energies.data()}, static_cast<int>(count));
+  return std::min(1.0, top / total);
+}
+
+} // namespace metrics
@@ -0,0 +1,290 @@
+/*
+  *profiler.hpp
+    Per-stage timers and counters for the hot paths (DFT, H, filtering,
+    inverse DFT, normalization, histogram, Haar transforms)
+  *PROFILE_SCOPE(name, bytes) times the rest of the enclosing block and
+   counts one call, `bytes` of memory read and written (an estimate given
+   by the caller) and the heap allocations made meanwhile (all threads;
+   only where allocations.hpp counts them, e.g. IMS built with the CMake
+   option IMS_COUNT_ALLOCATIONS; else the summary says n/a).
+  *Run time: IMS_PROFILE=1 prints calls, time percentiles, bandwidth and
+   allocations per stage at exit; IMS_TRACE=<file.json> also writes every
+   call as a Chrome trace (chrome://tracing, Perfetto). When neither is set
+   a scope costs one relaxed atomic load.
+  *Compile time: -DIMS_PROFILING=0 (CMake option IMS_PROFILING=OFF) turns
+   PROFILE_SCOPE into nothing, its arguments are not even evaluated.
+*/
+
+#pragma once
+
+#ifndef IMS_PROFILING
+#define IMS_PROFILING 1
+#endif
+
+#if IMS_PROFILING
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "allocations.hpp"
+
+namespace profiling
+{
+
+// Calls kept for the trace; later ones are only aggregated
+const std::size_t kMaxTraceEvents = 1 << 20;
+
+// One finished call of a stage
+struct Event
+{
+  const char* name;
+  long long startNs;
+  long long durationNs;
+  long long bytes;
+  long long allocations;
+  int thread;
+};
+
+// Samples kept per stage for the percentiles; later calls replace random ones
+const std::size_t kReservoirSize = 4096;
+
+// Aggregate of every call of one stage; the time percentiles come from a
+// uniform sample of the calls (reservoir sampling), so memory stays bounded
+struct StageStats
+{
+  long long calls = 0;
+  double totalMs = 0.0;
+  double maxMs = 0.0;
+  std::vector<double> sample;
+  std::uint64_t random = 0x9E3779B97F4A7C15ull;
+  long long bytes = 0;
+  long long allocations = 0;
+
+  void add(double ms)
+  {
+    calls++;
+    totalMs += ms;
+    maxMs = std::max(maxMs, ms);
+    if (sample.size() < kReservoirSize)
+    {
+      sample.push_back(ms);
+      return;
+    }
+    // xorshift64, enough to pick which sample to replace
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    const std::uint64_t slot = random % static_cast<std::uint64_t>(calls);
+    if (slot < kReservoirSize)
+    {
+      sample[slot] = ms;
+    }
+  }
+};
+
+// Orders stage names by text: the same literal may have several addresses
+struct NameLess
+{
+  bool operator()(const char* a, const char* b) const { return std::strcmp(a, b) < 0; }
+};
+
+class Profiler
+{
+public:
+  Profiler() : origin_(std::chrono::steady_clock::now())
+  {
+    const char* profile = std::getenv("IMS_PROFILE");
+    const char* trace = std::getenv("IMS_TRACE");
+    tracePath_ = trace ? trace : "";
+    enabled_ = (profile && std::string(profile) != "0") || !tracePath_.empty();
+  }
+
+  // Prints the summary and writes the trace of the whole run
+  ~Profiler()
+  {
+    if (!enabled_)
+    {
+      return;
+    }
+    printSummary(std::cerr);
+    if (!tracePath_.empty() && !writeTrace(tracePath_))
+    {
+      std::cerr << "Error: could not write " << tracePath_ << std::endl;
+    }
+  }
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // Function to switch profiling on or off; an empty path writes no trace
+  void enable(bool on, const std::string& tracePath = "")
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tracePath_ = tracePath;
+    enabled_ = on;
+  }
+
+  long long nowNs() const
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin_).count();
+  }
+
+  void record(const Event& event)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StageStats& stats = stages_[event.name];
+    stats.add(event.durationNs / 1e6);
+    stats.bytes += event.bytes;
+    stats.allocations += event.allocations;
+    if (!tracePath_.empty())
+    {
+      if (events_.size() < kMaxTraceEvents)
+      {
+        events_.push_back(event);
+      }
+      else
+      {
+        dropped_++;
+      }
+    }
+  }
+
+  // Function to print calls, total and p50/p90/p99/max time, bandwidth and
+  // allocations per call of every stage (times include nested stages; the
+  // percentiles are over at most kReservoirSize sampled calls)
+  void printSummary(std::ostream& out)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stages_.empty())
+    {
+      return;
+    }
+    out << "Profile (ms per call unless noted)\n";
+    out << std::setw(20) << "stage" << std::setw(8) << "calls" << std::setw(11) << "total ms" << std::setw(9) << "p50"
+        << std::setw(9) << "p90" << std::setw(9) << "p99" << std::setw(9) << "max" << std::setw(9) << "GB/s"
+        << std::setw(9) << "allocs" << "\n";
+    out << std::fixed;
+    for (auto& [name, stats] : stages_)
+    {
+      std::vector<double> ms = stats.sample;
+      std::sort(ms.begin(), ms.end());
+      auto percentile = [&](double p) { return ms[static_cast<std::size_t>(p * (ms.size() - 1) + 0.5)]; };
+      const double total = stats.totalMs;
+      out << std::setw(20) << name << std::setw(8) << stats.calls << std::setprecision(2) << std::setw(11) << total
+          << std::setprecision(3) << std::setw(9) << percentile(0.5) << std::setw(9) << percentile(0.9) << std::setw(9)
+          << percentile(0.99) << std::setw(9) << stats.maxMs << std::setprecision(2) << std::setw(9)
+          << (total > 0.0 ? stats.bytes / (total * 1e6) : 0.0) << std::setprecision(1) << std::setw(9);
+#if defined(ALLOCATIONS_COUNTED)
+      out << stats.allocations / static_cast<double>(stats.calls) << "\n";
+#else
+      out << "n/a" << "\n";
+#endif
+    }
+    if (dropped_ > 0)
+    {
+      out << dropped_ << " calls left out of the trace (limit " << kMaxTraceEvents << ")\n";
+    }
+    out << std::defaultfloat << std::flush;
+  }
+
+  // Function to write the recorded calls in the Chrome trace event format
+  bool writeTrace(const std::string& path)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ofstream file(path);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    file << std::fixed << std::setprecision(3);
+    for (std::size_t i = 0; i < events_.size(); i++)
+    {
+      const Event& e = events_[i];
+      file << "  {\"name\": \"" << e.name << "\", \"cat\": \"ims\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+           << ", \"ts\": " << e.startNs / 1e3 << ", \"dur\": " << e.durationNs / 1e3 << ", \"args\": {\"bytes\": "
+           << e.bytes << ", \"allocations\": " << e.allocations << "}}" << (i + 1 < events_.size() ? "," : "")
+           << "\n";
+    }
+    file << "]}\n";
+    return static_cast<bool>(file);
+  }
+
+private:
+  std::atomic<bool> enabled_{false};
+  std::string tracePath_;
+  const std::chrono::steady_clock::time_point origin_;
+  std::mutex mutex_;
+  std::map<const char*, StageStats, NameLess> stages_;
+  std::vector<Event> events_;
+  long long dropped_ = 0;
+};
+
+// The profiler of the process; reports when the program exits
+inline Profiler instance;
+
+inline Profiler& profiler() { return instance; }
+
+// Small sequential id of the calling thread, for the trace
+inline int threadId()
+{
+  static std::atomic<int> next(0);
+  thread_local const int id = next++;
+  return id;
+}
+
+// Times the enclosing block as one call of stage `name`
+class Scope
+{
+public:
+  Scope(const char* name, long long bytes)
+  {
+    if (!profiler().enabled())
+    {
+      return;
+    }
+    name_ = name;
+    bytes_ = bytes;
+    allocations_ = allocations::count();
+    startNs_ = profiler().nowNs();
+  }
+
+  ~Scope()
+  {
+    if (!name_)
+    {
+      return;
+    }
+    const long long endNs = profiler().nowNs();
+    profiler().record({name_, startNs_, endNs - startNs_, bytes_, allocations::count() - allocations_, threadId()});
+  }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+private:
+  const char* name_ = nullptr;
+  long long bytes_ = 0;
+  long long allocations_ = 0;
+  long long startNs_ = 0;
+};
+
+} // namespace profiling
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name, bytes)                                                                                    \
+  profiling::Scope PROFILE_CONCAT(profileScope, __LINE__)(                                                             \
+      name, profiling::profiler().enabled() ? static_cast<long long>(bytes) : 0)
+
+#else
+
+#define PROFILE_SCOPE(name, bytes) ((void)0)
+
+#endif
@@ -0,0 +1,474 @@
+/*
+  *shrinkage.hpp
+    Shrinkage of wavelet detail coefficients and automatic thresholds
+  *Shrinkage runs as its own pass over each detail subband, one row at a
+   time, with branchless kernels (compare and select, no fabs or sgn) in
+   vector lanes, picked for the running CPU like the metrics.hpp kernels.
+   Garrot only divides where the coefficient survives, in whole vectors.
+  *Thresholds per subband, from the noise level sigma of the image, taken
+   as the median absolute value of the finest diagonal subband / 0.6745:
+     VisuShrink: sigma * sqrt(2 ln N), N the number of pixels
+     BayesShrink: sigma^2 / sigma_x, sigma_x^2 = max(mean(d^2) - sigma^2, 0)
+     SURE: the minimum of Stein's unbiased risk estimate of soft
+           thresholding, over a histogram of |d| / sigma up to the universal
+           threshold; the universal threshold where the subband is sparse
+   The sums behind them are parallel reductions over rows, merged in chunk
+   order so the thresholds do not depend on scheduling.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+#include "metrics.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+// Filter type
+#define NONE 0   // no filter
+#define HARD 1   // hard shrinkage
+#define SOFT 2   // soft shrinkage
+#define GARROT 3 // garrot filter
+
+namespace shrinkage
+{
+
+// Histogram bins of the SURE search, from 0 to the universal threshold
+const int kSureBins = 1024;
+
+enum class Estimator
+{
+  Visu,
+  Bayes,
+  Sure
+};
+
+const char* estimatorName(Estimator estimator)
+{
+  switch (estimator)
+  {
+    case Estimator::Visu:
+      return "visu";
+    case Estimator::Bayes:
+      return "bayes";
+    default:
+      return "sure";
+  }
+}
+
+// Function to parse "visu", "bayes" or "sure"; false for anything else
+bool parseEstimator(const std::string& name, Estimator& estimator)
+{
+  for (Estimator e : {Estimator::Visu, Estimator::Bayes, Estimator::Sure})
+  {
+    if (name == estimatorName(e))
+    {
+      estimator = e;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Function to list the detail subbands of a Haar layout (cvHaarWavelet,
+// haarForward): HL, LH, HH of every level, finest level first
+std::vector<cv::Rect> haarSubbands(cv::Size size, int levels)
+{
+  std::vector<cv::Rect> subbands;
+  for (int k = 0; k < levels; k++)
+  {
+    const int halfH = size.height >> (k + 1);
+    const int halfW = size.width >> (k + 1);
+    if (halfH == 0 || halfW == 0)
+    {
+      break;
+    }
+    subbands.push_back(cv::Rect(halfW, 0, halfW, halfH));
+    subbands.push_back(cv::Rect(0, halfH, halfW, halfH));
+    subbands.push_back(cv::Rect(halfW, halfH, halfW, halfH));
+  }
+  return subbands;
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+// Branchless kernels: apply(d) for a vector (or a float) of coefficients
+template <typename V>
+SIMD_INLINE V absolute(const V& d)
+{
+  return d < 0.0f ? -d : d;
+}
+
+// d where |d| > T, else 0
+struct Hard
+{
+  float T;
+
+  template <typename V>
+  SIMD_INLINE V apply(const V& d) const
+  {
+    const V zero = V{} + 0.0f;
+    return absolute(d) > T ? d : zero;
+  }
+};
+
+// sgn(d) * max(|d| - T, 0), as d minus d clamped to [-T, T]
+struct Soft
+{
+  float T;
+
+  template <typename V>
+  SIMD_INLINE V apply(const V& d) const
+  {
+    const V low = V{} - T;
+    const V high = V{} + T;
+    const V clamped = d < low ? low : (d > high ? high : d);
+    return d - clamped;
+  }
+};
+
+// d - T^2 / d where |d| > T, else 0; the shrunk lanes divide by 1
+struct Garrot
+{
+  float T;
+  float T2; // T * T
+
+  template <typename V>
+  SIMD_INLINE V apply(const V& d) const
+  {
+    const V zero = V{} + 0.0f;
+    const V one = V{} + 1.0f;
+    const auto keep = absolute(d) > T;
+    const V divisor = keep ? d : one;
+    return keep ? d - T2 / divisor : zero;
+  }
+};
+
+template <typename V, typename Kernel>
+SIMD_INLINE int shrinkLanes(const Kernel& kernel, float* row, int begin, int n)
+{
+  constexpr int L = simd::lanes<V, float>();
+  int i = begin;
+  for (; i + L <= n; i += L)
+  {
+    simd::store(row + i, kernel.template apply<V>(simd::load<V>(row + i)));
+  }
+  return i;
+}
+
+template <typename V, typename Kernel>
+SIMD_INLINE void shrinkRow(const Kernel& kernel, float* row, int n)
+{
+  const int i = shrinkLanes<V>(kernel, row, 0, n);
+  shrinkLanes<float>(kernel, row, i, n);
+}
+
+// Per-instruction-set instantiations of shrinkRow
+template <typename Kernel>
+void shrinkRowScalar(const Kernel& kernel, float* row, int n)
+{
+  shrinkRow<float>(kernel, row, n);
+}
+
+#if defined(SIMD_X86)
+template <typename Kernel>
+SIMD_TARGET("sse2") void shrinkRowSse2(const Kernel& kernel, float* row, int n)
+{
+  shrinkRow<simd::Vector<float, 16>::type>(kernel, row, n);
+}
+
+template <typename Kernel>
+SIMD_TARGET("avx2,fma") void shrinkRowAvx2(const Kernel& kernel, float* row, int n)
+{
+  shrinkRow<simd::Vector<float, 32>::type>(kernel, row, n);
+}
+#endif
+
+#if defined(SIMD_NEON)
+template <typename Kernel>
+void shrinkRowNeon(const Kernel& kernel, float* row, int n)
+{
+  shrinkRow<simd::Vector<float, 16>::type>(kernel, row, n);
+}
+#endif
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+// Function to get the row kernel of the CPU for one shrinkage kernel
+template <typename Kernel>
+void (*rowKernel())(const Kernel&, float*, int)
+{
+  switch (simd::bestIsa())
+  {
+#if defined(SIMD_X86)
+    case simd::Isa::AVX2:
+      return &shrinkRowAvx2<Kernel>;
+    case simd::Isa::SSE2:
+      return &shrinkRowSse2<Kernel>;
+#endif
+#if defined(SIMD_NEON)
+    case simd::Isa::NEON:
+      return &shrinkRowNeon<Kernel>;
+#endif
+    default:
+      return &shrinkRowScalar<Kernel>;
+  }
+}
+
+template <typename Kernel>
+void shrinkRows(cv::Mat& coefficients, const cv::Rect& band, const Kernel& kernel, int threads)
+{
+  auto shrink = rowKernel<Kernel>();
+  threading::defaultPool().parallelFor(
+      band.height,
+      [&](int begin, int end, int)
+      {
+        for (int y = begin; y < end; y++)
+        {
+          shrink(kernel, coefficients.ptr<float>(band.y + y) + band.x, band.width);
+        }
+      },
+      threads);
+}
+
+// Applies shrinkage (NONE, HARD, SOFT or GARROT with threshold T) to one
+// subband of a CV_32FC1 coefficient matrix, in place.
+// threads: 0 = all cores, 1 = serial
+void shrinkSubband(cv::Mat& coefficients, const cv::Rect& band, int shrinkageType, float T, int threads = 0)
+{
+  CV_Assert(coefficients.type() == CV_32FC1);
+  switch (shrinkageType)
+  {
+    case HARD:
+      shrinkRows(coefficients, band, Hard{T}, threads);
+      break;
+    case SOFT:
+      shrinkRows(coefficients, band, Soft{T}, threads);
+      break;
+    case GARROT:
+      shrinkRows(coefficients, band, Garrot{T, T * T}, threads);
+      break;
+  }
+}
+
+// Applies shrinkage to every subband, with one threshold for all of them
+void shrinkSubbands(cv::Mat& coefficients, const std::vector<cv::Rect>& subbands, int shrinkageType, float T,
+                    int threads = 0)
+{
+  for (const cv::Rect& band : subbands)
+  {
+    shrinkSubband(coefficients, band, shrinkageType, T, threads);
+  }
+}
+
+// Applies shrinkage to every subband with its own threshold
+void shrinkSubbands(cv::Mat& coefficients, const std::vector<cv::Rect>& subbands, int shrinkageType,
+                    const std::vector<float>& thresholds, int threads = 0)
+{
+  CV_Assert(thresholds.size() == subbands.size());
+  for (std::size_t i = 0; i < subbands.size(); i++)
+  {
+    shrinkSubband(coefficients, subbands[i], shrinkageType, thresholds[i], threads);
+  }
+}
+
+// Function to run fn(row, width, chunk) over the rows of a subband in
+// parallel; returns the number of chunks, so per-chunk results can be merged in order
+template <typename F>
+int forEachRow(const cv::Mat& coefficients, const cv::Rect& band, int threads, F&& fn)
+{
+  threading::ThreadPool& pool = threading::defaultPool();
+  threads = threads > 0 ? std::min(threads, pool.size()) : pool.size();
+  const int chunks = std::max(1, std::min(band.height, threads));
+  pool.parallelFor(
+      band.height,
+      [&](int begin, int end, int chunk)
+      {
+        for (int y = begin; y < end; y++)
+        {
+          fn(coefficients.ptr<float>(band.y + y) + band.x, band.width, chunk);
+        }
+      },
+      chunks);
+  return chunks;
+}
+
+// Function to sum d^2 over a subband (a parallel reduction)
+double sumOfSquares(const cv::Mat& coefficients, const cv::Rect& band, int threads = 0)
+{
+  std::vector<double> partial(threading::defaultPool().size(), 0.0);
+  const int chunks = forEachRow(coefficients, band, threads, [&](const float* row, int n, int chunk)
+                                { partial[chunk] += metrics::reduce(metrics::Square{row}, n); });
+  double sum = 0.0;
+  for (int c = 0; c < chunks; c++)
+  {
+    sum += partial[c];
+  }
+  return sum;
+}
+
+// Function to estimate the noise standard deviation from the finest
+// diagonal subband: median(|d|) / 0.6745 (Donoho & Johnstone)
+double noiseSigma(const cv::Mat& coefficients, const cv::Rect& hh)
+{
+  std::vector<float> magnitudes;
+  magnitudes.reserve(hh.area());
+  for (int y = 0; y < hh.height; y++)
+  {
+    const float* row = coefficients.ptr<float>(hh.y + y) + hh.x;
+    for (int x = 0; x < hh.width; x++)
+    {
+      magnitudes.push_back(std::abs(row[x]));
+    }
+  }
+  if (magnitudes.empty())
+  {
+    return 0.0;
+  }
+  auto middle = magnitudes.begin() + magnitudes.size() / 2;
+  std::nth_element(magnitudes.begin(), middle, magnitudes.end());
+  return *middle / 0.6745;
+}
+
+// Universal threshold sigma * sqrt(2 ln n)
+double visuThreshold(double sigma, double n) { return sigma * std::sqrt(2.0 * std::log(std::max(n, 2.0))); }
+
+// Function to get the largest |d| of a subband (a parallel reduction)
+double maxAbsolute(const cv::Mat& coefficients, const cv::Rect& band, int threads = 0)
+{
+  std::vector<float> partial(threading::defaultPool().size(), 0.0f);
+  const int chunks = forEachRow(coefficients, band, threads,
+                                [&](const float* row, int n, int chunk)
+                                {
+                                  for (int x = 0; x < n; x++)
+                                  {
+                                    partial[chunk] = std::max(partial[chunk], std::abs(row[x]));
+                                  }
+                                });
+  return *std::max_element(partial.begin(), partial.begin() + chunks);
+}
+
+// BayesShrink threshold of one subband (Chang, Yu & Vetterli). A subband
+// with no signal above the noise gets its largest |d|, which removes all of it.
+double bayesThreshold(const cv::Mat& coefficients, const cv::Rect& band, double sigma, int threads = 0)
+{
+  const double variance = sumOfSquares(coefficients, band, threads) / std::max(1, band.area());
+  const double signal = std::sqrt(std::max(variance - sigma * sigma, 0.0));
+  return signal > 0.0 ? sigma * sigma / signal : maxAbsolute(coefficients, band, threads);
+}
+
+// SureShrink threshold of one subband (Donoho & Johnstone 1995), for x = d / sigma:
+// SURE(t) = n - 2 #{|x| <= t} + sum min(x^2, t^2), minimized over the bin
+// edges of a histogram of |x| below the universal threshold. Subbands with
+// sum(x^2 - 1) / n <= log2(n)^1.5 / sqrt(n) are taken as sparse and get the
+// universal threshold.
+double sureThreshold(const cv::Mat& coefficients, const cv::Rect& band, double sigma, int threads = 0)
+{
+  const double n = band.area();
+  const double universal = std::sqrt(2.0 * std::log(std::max(n, 2.0)));
+  if (sigma <= 0.0 || n < 1.0)
+  {
+    return 0.0;
+  }
+  const double energy = sumOfSquares(coefficients, band, threads) / (sigma * sigma);
+  if ((energy - n) / n <= std::pow(std::log2(n), 1.5) / std::sqrt(n))
+  {
+    return universal * sigma;
+  }
+
+  // Count and sum of x^2 per bin, per chunk; coefficients above the last edge only count in the total
+  const int slots = threading::defaultPool().size();
+  std::vector<double> counts(static_cast<std::size_t>(slots) * kSureBins, 0.0);
+  std::vector<double> squares(counts.size(), 0.0);
+  const double scale = kSureBins / (universal * sigma);
+  const int chunks = forEachRow(coefficients, band, threads,
+                                [&](const float* row, int width, int chunk)
+                                {
+                                  double* count = counts.data() + static_cast<std::size_t>(chunk) * kSureBins;
+                                  double* square = squares.data() + static_cast<std::size_t>(chunk) * kSureBins;
+                                  for (int x = 0; x < width; x++)
+                                  {
+                                    const double a = std::abs(row[x]);
+                                    const int bin = static_cast<int>(a * scale);
+                                    if (bin < kSureBins)
+                                    {
+                                      count[bin] += 1.0;
+                                      square[bin] += a * a;
+                                    }
+                                  }
+                                });
+
+  // Risk at the upper edge t of every bin: coefficients below t contribute x^2, the others t^2
+  double below = 0.0;
+  double belowSquares = 0.0;
+  double bestRisk = std::numeric_limits<double>::max();
+  double best = universal;
+  for (int b = 0; b < kSureBins; b++)
+  {
+    for (int c = 0; c < chunks; c++)
+    {
+      below += counts[static_cast<std::size_t>(c) * kSureBins + b];
+      belowSquares += squares[static_cast<std::size_t>(c) * kSureBins + b] / (sigma * sigma);
+    }
+    const double t = universal * (b + 1) / kSureBins;
+    const double risk = n - 2.0 * below + belowSquares + (n - below) * t * t;
+    if (risk < bestRisk)
+    {
+      bestRisk = risk;
+      best = t;
+    }
+  }
+  return best * sigma;
+}
+
+// Function to estimate one threshold per subband (haarSubbands order: the
+// third one is the finest diagonal subband, used for the noise level)
+std::vector<float> estimateThresholds(const cv::Mat& coefficients, const std::vector<cv::Rect>& subbands,
+                                      Estimator estimator, int threads = 0)
+{
+  CV_Assert(coefficients.type() == CV_32FC1);
+  std::vector<float> thresholds;
+  if (subbands.size() < 3)
+  {
+    return std::vector<float>(subbands.size(), 0.0f);
+  }
+  const double sigma = noiseSigma(coefficients, subbands[2]);
+  for (const cv::Rect& band : subbands)
+  {
+    double T = 0.0;
+    switch (estimator)
+    {
+      case Estimator::Visu:
+        T = visuThreshold(sigma, static_cast<double>(coefficients.total()));
+        break;
+      case Estimator::Bayes:
+        T = bayesThreshold(coefficients, band, sigma, threads);
+        break;
+      case Estimator::Sure:
+        T = sureThreshold(coefficients, band, sigma, threads);
+        break;
+    }
+    thresholds.push_back(static_cast<float>(T));
+  }
+  return thresholds;
+}
+
+// Estimates the thresholds and shrinks every subband with them
+void denoise(cv::Mat& coefficients, const std::vector<cv::Rect>& subbands, int shrinkageType, Estimator estimator,
+             int threads = 0)
+{
+  shrinkSubbands(coefficients, subbands, shrinkageType, estimateThresholds(coefficients, subbands, estimator, threads),
+                 threads);
+}
+
+} // namespace shrinkage
@@ -0,0 +1,116 @@
+/*
+  *simd.hpp
+    Short-vector types and runtime CPU detection for the SIMD kernels.
+  *Kernels are written once as templates over a vector type V
+   (GCC/Clang vector extensions, or plain T for the scalar reference)
+   and instantiated per instruction set inside wrappers that carry the
+   matching target attribute, so no global -mavx2 is needed.
+*/
+
+#pragma once
+
+#include <cstring>
+
+namespace simd
+{
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#elif defined(__GNUC__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define SIMD_NEON 1
+#endif
+
+#if defined(__GNUC__)
+#define SIMD_INLINE __attribute__((always_inline)) inline
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_INLINE inline
+#define SIMD_TARGET(isa)
+#endif
+
+// Instruction sets with dedicated kernels
+enum class Isa
+{
+  Scalar,
+  SSE2,
+  AVX2,
+  NEON
+};
+
+const char* isaName(Isa isa)
+{
+  switch (isa)
+  {
+    case Isa::SSE2:
+      return "SSE2";
+    case Isa::AVX2:
+      return "AVX2";
+    case Isa::NEON:
+      return "NEON";
+    default:
+      return "Scalar";
+  }
+}
+
+// Best instruction set of the running CPU, detected once
+Isa bestIsa()
+{
+  static const Isa isa = []
+  {
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+      return Isa::AVX2;
+    }
+    return __builtin_cpu_supports("sse2") ? Isa::SSE2 : Isa::Scalar;
+#elif defined(SIMD_NEON)
+    return Isa::NEON;
+#else
+    return Isa::Scalar;
+#endif
+  }();
+  return isa;
+}
+
+#if defined(__GNUC__)
+// Vector of Bytes / sizeof(T) lanes of T
+template <typename T, int Bytes>
+struct Vector
+{
+  typedef T type __attribute__((vector_size(Bytes)));
+};
+#endif
+
+// Number of T lanes in V (1 when V is T itself)
+template <typename V, typename T>
+constexpr int lanes()
+{
+  return sizeof(V) / sizeof(T);
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi" // always inlined, the vector ABI never matters
+#endif
+
+// Unaligned load/store; with V == T they are plain scalar accesses
+template <typename V, typename T>
+SIMD_INLINE V load(const T* p)
+{
+  V v;
+  std::memcpy(&v, p, sizeof(V));
+  return v;
+}
+
+template <typename V, typename T>
+SIMD_INLINE void store(T* p, const V& v)
+{
+  std::memcpy(p, &v, sizeof(V));
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+} // namespace simd
@@ -0,0 +1,439 @@
+/*
+  *streaming.hpp
+    Frequency-domain filtering of video files and camera streams
+  *Usage:
+     IMS --video <file|camera index> --output <file> --filter <spec> [--filter <spec> ...]
+         [--queue N] [--threads N] [--frames N] [--fourcc XXXX]
+   <spec> is "type:D0[:n[:epsilon]]" as in batch mode.
+  *Decode, forward DFT, spectral multiply, inverse DFT and encode run as a
+   pipeline, one thread per stage, connected by bounded queues: a slow stage
+   makes the stages before it wait instead of buffering frames without limit.
+  *One FFT plan and one H are built from the first frame and reused for the
+   whole stream. Sustained fps and per-stage latency are printed at the end.
+  *An exception in a stage stops the pipeline: every stage then only drains
+   its queue, and run reports the first error. A stream cut short (error,
+   size change, failed write) exits with 1.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FFT.hpp"
+#include "filter_cache.hpp"
+#include "image_processing.hpp"
+
+namespace streaming
+{
+
+typedef std::chrono::steady_clock Clock;
+
+// Fixed-capacity FIFO between two pipeline stages. push() blocks while the
+// queue is full (backpressure); pop() blocks while it is empty and returns
+// false once the queue is closed and drained.
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(std::size_t capacity) : capacity_(std::max<std::size_t>(1, capacity)) {}
+
+  void push(T item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(lock, [this] { return items_.size() < capacity_ || closed_; });
+    items_.push_back(std::move(item));
+    notEmpty_.notify_one();
+  }
+
+  bool pop(T& item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notEmpty_.wait(lock, [this] { return !items_.empty() || closed_; });
+    if (items_.empty())
+    {
+      return false;
+    }
+    item = std::move(items_.front());
+    items_.pop_front();
+    notFull_.notify_one();
+    return true;
+  }
+
+  // No more items will be pushed
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    notEmpty_.notify_all();
+    notFull_.notify_all();
+  }
+
+private:
+  std::size_t capacity_;
+  std::deque<T> items_;
+  bool closed_ = false;
+  std::mutex mutex_;
+  std::condition_variable notEmpty_;
+  std::condition_variable notFull_;
+};
+
+// One frame on its way through the pipeline
+struct Frame
+{
+  int index = 0;
+  Clock::time_point decoded;
+  cv::Mat image;    // 8-bit gray input, then the filtered 8-bit output
+  cv::Mat spectrum; // Half spectrum (CV_32FC2)
+};
+
+// Processing time of one stage (queue waits excluded)
+struct StageStats
+{
+  std::string name;
+  int frames = 0;
+  double totalMs = 0.0;
+  double maxMs = 0.0;
+
+  void add(double ms)
+  {
+    frames++;
+    totalMs += ms;
+    maxMs = std::max(maxMs, ms);
+  }
+};
+
+struct Options
+{
+  std::string input;  // Video file, or camera index
+  std::string output; // Output video file
+  std::vector<image_processing::FilterSpec> chain;
+  int queueCapacity = 4; // Frames per queue between two stages
+  int threads = 0;       // Threads per FFT stage, 0 = all cores
+  int maxFrames = -1;    // Stop after this many frames (-1 = whole stream)
+  std::string fourcc = "MJPG";
+};
+
+// First error of any stage; once set the pipeline only drains its queues
+class Failure
+{
+public:
+  void set(const std::string& message)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!failed_)
+    {
+      message_ = message;
+      failed_ = true;
+    }
+  }
+
+  bool failed() const { return failed_; }
+
+  std::string message() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return message_;
+  }
+
+private:
+  std::atomic<bool> failed_{false};
+  std::string message_;
+  mutable std::mutex mutex_;
+};
+
+// Function to run fn on every frame of `in`, forwarding the frames to `out`
+// (when given) and closing it once `in` is drained. An exception of fn is
+// recorded in `failure`; from then on frames are dropped, so the stages
+// before this one never block on a full queue.
+template <typename F>
+std::thread startStage(BoundedQueue<Frame>& in, BoundedQueue<Frame>* out, StageStats& stats, Failure& failure,
+                       F fn)
+{
+  return std::thread(
+      [&in, out, &stats, &failure, fn]() mutable
+      {
+        Frame frame;
+        while (in.pop(frame))
+        {
+          if (failure.failed())
+          {
+            continue;
+          }
+          try
+          {
+            const auto start = Clock::now();
+            fn(frame);
+            stats.add(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+          }
+          catch (const std::exception& e)
+          {
+            failure.set(stats.name + " stage, frame " + std::to_string(frame.index) + ": " + e.what());
+            continue;
+          }
+          catch (...)
+          {
+            failure.set(stats.name + " stage, frame " + std::to_string(frame.index) + ": unknown error");
+            continue;
+          }
+          if (out)
+          {
+            out->push(std::move(frame));
+          }
+        }
+        if (out)
+        {
+          out->close();
+        }
+      });
+}
+
+// Function to read one frame as 8-bit gray; false at the end of the stream
+bool readGray(cv::VideoCapture& capture, cv::Mat& gray)
+{
+  cv::Mat frame;
+  if (!capture.read(frame) || frame.empty())
+  {
+    return false;
+  }
+  if (frame.channels() == 3)
+  {
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+  }
+  else
+  {
+    gray = frame;
+  }
+  return true;
+}
+
+// Function to filter a whole stream; returns the process exit code
+int run(const Options& options)
+{
+  const bool camera = !options.input.empty() && std::all_of(options.input.begin(), options.input.end(), ::isdigit);
+  cv::VideoCapture capture;
+  if (camera)
+  {
+    capture.open(std::stoi(options.input));
+  }
+  else
+  {
+    capture.open(options.input);
+  }
+  cv::Mat first;
+  if (!capture.isOpened() || !readGray(capture, first))
+  {
+    std::cerr << "Error: could not read from " << options.input << std::endl;
+    return 1;
+  }
+
+  // Everything that depends only on the frame size is built once
+  const FFT::RealPlan2d<float> plan(first.rows, first.cols);
+  const std::shared_ptr<const cv::Mat> H = image_processing::filterCache().get(first, options.chain);
+
+  double fps = capture.get(cv::CAP_PROP_FPS);
+  if (fps <= 0.0)
+  {
+    fps = 25.0;
+  }
+  const std::string& code = options.fourcc;
+  cv::VideoWriter writer(options.output, cv::VideoWriter::fourcc(code[0], code[1], code[2], code[3]), fps,
+                         first.size(), false);
+  if (!writer.isOpened())
+  {
+    std::cerr << "Error: could not open " << options.output << " for writing" << std::endl;
+    return 1;
+  }
+
+  BoundedQueue<Frame> decoded(options.queueCapacity), transformed(options.queueCapacity),
+      filtered(options.queueCapacity), restored(options.queueCapacity);
+  std::vector<StageStats> stats = {{"decode"}, {"forward DFT"}, {"filter"}, {"inverse DFT"}, {"encode"}};
+  StageStats endToEnd{"end to end"};
+  const int threads = options.threads;
+  Failure failure;
+  const auto start = Clock::now();
+
+  std::vector<std::thread> stages;
+  stages.push_back(startStage(decoded, &transformed, stats[1], failure,
+                              [&](Frame& frame) { plan.forward(frame.image, frame.spectrum, threads); }));
+  stages.push_back(startStage(transformed, &filtered, stats[2], failure,
+                              [&](Frame& frame) { image_processing::filtering(frame.spectrum, frame.spectrum, *H); }));
+  stages.push_back(startStage(filtered, &restored, stats[3], failure,
+                              [&](Frame& frame)
+                              {
+                                cv::Mat restoredImage;
+                                plan.inverse(frame.spectrum, restoredImage, threads);
+                                cv::normalize(restoredImage, frame.image, 0, 255, cv::NORM_MINMAX, CV_8U);
+                              }));
+  stages.push_back(startStage(restored, nullptr, stats[4], failure,
+                              [&](Frame& frame)
+                              {
+                                writer.write(frame.image);
+                                if (!writer.isOpened())
+                                {
+                                  throw std::runtime_error("could not write to " + options.output);
+                                }
+                                const auto latency = Clock::now() - frame.decoded;
+                                endToEnd.add(std::chrono::duration<double, std::milli>(latency).count());
+                              }));
+
+  // Decode on this thread; push() blocks while the pipeline is full
+  bool cutShort = false;
+  try
+  {
+    Frame frame;
+    frame.image = first;
+    for (int index = 0; (options.maxFrames < 0 || index < options.maxFrames) && !failure.failed(); index++)
+    {
+      const auto begin = Clock::now();
+      if (index > 0 && !readGray(capture, frame.image))
+      {
+        break;
+      }
+      if (frame.image.size() != first.size())
+      {
+        std::cerr << "Error: frame " << index << " changes the frame size, stopping" << std::endl;
+        cutShort = true;
+        break;
+      }
+      frame.index = index;
+      frame.decoded = Clock::now();
+      stats[0].add(std::chrono::duration<double, std::milli>(frame.decoded - begin).count());
+      decoded.push(std::move(frame));
+      frame = Frame();
+    }
+  }
+  catch (const std::exception& e)
+  {
+    failure.set(std::string("decode stage: ") + e.what());
+  }
+  decoded.close();
+  for (std::thread& stage : stages)
+  {
+    stage.join();
+  }
+  writer.release();
+  if (failure.failed())
+  {
+    std::cerr << "Error: " << failure.message() << std::endl;
+    cutShort = true;
+  }
+  std::error_code error;
+  const auto written = std::filesystem::file_size(options.output, error);
+  if (endToEnd.frames > 0 && (error || written == 0))
+  {
+    std::cerr << "Error: nothing was written to " << options.output << std::endl;
+    cutShort = true;
+  }
+
+  const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << endToEnd.frames << " frames (" << first.cols << "x" << first.rows << ") in " << seconds << " s: "
+            << endToEnd.frames / seconds << " fps sustained\n";
+  stats.push_back(endToEnd);
+  for (const StageStats& stage : stats)
+  {
+    const double mean = stage.frames ? stage.totalMs / stage.frames : 0.0;
+    std::cout << std::setw(12) << stage.name << ": " << mean << " ms/frame mean, " << stage.maxMs << " ms max\n";
+  }
+  return cutShort ? 1 : 0;
+}
+
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program
+            << " --video <file|camera index> --output <file> --filter <type:D0[:n[:epsilon]]> [--filter ...]"
+               " [--queue N] [--threads N] [--frames N] [--fourcc XXXX]\n";
+}
+
+// Function to parse the command line; false (after printing why) if it is invalid
+bool parseArguments(int argc, char** argv, Options& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      std::cerr << "Error: missing value for " << arg << std::endl;
+      return false;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--video")
+    {
+      options.input = value;
+    }
+    else if (arg == "--output")
+    {
+      options.output = value;
+    }
+    else if (arg == "--filter")
+    {
+      image_processing::FilterSpec spec;
+      if (!image_processing::parseFilterSpec(value, spec))
+      {
+        std::cerr << "Error: invalid filter spec '" << value << "'" << std::endl;
+        return false;
+      }
+      options.chain.push_back(spec);
+    }
+    else if (arg == "--queue")
+    {
+      options.queueCapacity = std::atoi(value.c_str());
+    }
+    else if (arg == "--threads")
+    {
+      options.threads = std::atoi(value.c_str());
+    }
+    else if (arg == "--frames")
+    {
+      options.maxFrames = std::atoi(value.c_str());
+    }
+    else if (arg == "--fourcc" && value.size() == 4)
+    {
+      options.fourcc = value;
+    }
+    else
+    {
+      std::cerr << "Error: invalid option " << arg << " " << value << std::endl;
+      return false;
+    }
+  }
+
+  if (options.input.empty() || options.output.empty() || options.chain.empty())
+  {
+    std::cerr << "Error: --video, --output and at least one --filter are required" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Entry point of the streaming mode
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!parseArguments(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+  return run(options);
+}
+
+} // namespace streaming
@@ -0,0 +1,407 @@
+/*
+  *sweep.hpp
+    Parameter sweep: runs many filter / shrinkage settings on one image in
+    parallel and writes their quality metrics (metrics.hpp) to a CSV file
+  *Usage:
+     IMS --sweep <image> --output <file.csv> [--mode all|filters|wavelets]
+         [--filter <type>]... [--d0 from:to:step] [--order N] [--epsilon E]
+         [--thresholds from:to:step] [--estimator visu|bayes|sure]...
+         [--levels N] [--threads N]
+  *filters: every FilterType (or the --filter ones) at every D0, through
+   the fused spectral path; the filtered image is compared with the input
+   at its own scale (no min-max normalization).
+  *wavelets: hard, soft and Garrot shrinkage at every threshold on a Haar
+   transform of --levels levels (haarInverse, same result as
+   cvInvHaarWavelet); energy_compaction is the share of the energy of the
+   shrunk coefficients held by their largest 5%. Each --estimator (all
+   three by default) adds a row per shrinkage type with thresholds
+   estimated per subband (shrinkage.hpp); its parameter is their mean.
+  *The DFT and the Haar transform of the image are computed once and shared
+   read-only; each combination runs single-threaded on its own core.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "FFT.hpp"
+#include "image_processing.hpp"
+#include "metrics.hpp"
+#include "shrinkage.hpp"
+#include "thread_pool.hpp"
+#include "wavelets.hpp"
+
+namespace sweep
+{
+
+// Values from, from + step, ... up to `to` (inclusive)
+struct Range
+{
+  float from;
+  float to;
+  float step;
+
+  std::vector<float> values() const
+  {
+    std::vector<float> result;
+    for (int i = 0; step > 0.0f && from + i * step <= to + 1e-6f * std::abs(to); i++)
+    {
+      result.push_back(from + i * step);
+    }
+    return result;
+  }
+};
+
+// Function to parse "from:to:step"; false if it is invalid
+bool parseRange(const std::string& text, Range& range)
+{
+  std::istringstream stream(text);
+  char colon1 = 0, colon2 = 0;
+  Range parsed;
+  if (!(stream >> parsed.from >> colon1 >> parsed.to >> colon2 >> parsed.step) || colon1 != ':' || colon2 != ':' ||
+      parsed.step <= 0.0f || parsed.to < parsed.from)
+  {
+    return false;
+  }
+  range = parsed;
+  return true;
+}
+
+struct Options
+{
+  std::string input;
+  std::string output;
+  bool filters = true;
+  bool wavelets = true;
+  std::vector<image_processing::FilterType> types; // Empty = all
+  Range d0 = {5.0f, 100.0f, 5.0f};
+  int order = 2;
+  float epsilon = 0.5f;
+  Range thresholds = {5.0f, 100.0f, 5.0f};
+  std::vector<shrinkage::Estimator> estimators; // Empty = all
+  int levels = 3;
+  int threads = 0; // 0 = all cores
+};
+
+// One parameter combination: a filter, or a shrinkage type and threshold
+// (estimated per subband when automatic)
+struct Job
+{
+  bool filter;
+  image_processing::FilterSpec spec;
+  int shrinkageType;
+  float threshold;
+  bool automatic = false;
+  shrinkage::Estimator estimator = shrinkage::Estimator::Bayes;
+};
+
+// One CSV row
+struct Row
+{
+  std::string mode;
+  std::string variant;
+  float parameter = 0.0f;
+  double mse = 0.0;
+  double psnr = 0.0;
+  double ssim = 0.0;
+  double energyCompaction = std::nan(""); // Wavelet rows only
+  double ms = 0.0;
+};
+
+const char* shrinkageName(int shrinkageType)
+{
+  switch (shrinkageType)
+  {
+    case HARD:
+      return "hard";
+    case SOFT:
+      return "soft";
+    default:
+      return "garrot";
+  }
+}
+
+// Function to list the combinations of the options, filters first
+std::vector<Job> listJobs(const Options& options)
+{
+  std::vector<Job> jobs;
+  if (options.filters)
+  {
+    std::vector<image_processing::FilterType> types = options.types;
+    if (types.empty())
+    {
+      for (int i = 0; i <= static_cast<int>(image_processing::FilterType::ChebyshevLp); i++)
+      {
+        types.push_back(static_cast<image_processing::FilterType>(i));
+      }
+    }
+    for (image_processing::FilterType type : types)
+    {
+      for (float D0 : options.d0.values())
+      {
+        jobs.push_back({true, {type, D0, options.order, options.epsilon}, NONE, 0.0f});
+      }
+    }
+  }
+  if (options.wavelets)
+  {
+    for (int type : {HARD, SOFT, GARROT})
+    {
+      for (float T : options.thresholds.values())
+      {
+        jobs.push_back({false, {}, type, T});
+      }
+    }
+    std::vector<shrinkage::Estimator> estimators = options.estimators;
+    if (estimators.empty())
+    {
+      estimators = {shrinkage::Estimator::Visu, shrinkage::Estimator::Bayes, shrinkage::Estimator::Sure};
+    }
+    for (int type : {HARD, SOFT, GARROT})
+    {
+      for (shrinkage::Estimator estimator : estimators)
+      {
+        jobs.push_back({false, {}, type, 0.0f, true, estimator});
+      }
+    }
+  }
+  return jobs;
+}
+
+// Function to run one combination; `image` is the CV_32F input, `spectrum`
+// its half spectrum and `haar` its Haar coefficients
+Row runJob(const Job& job, const Options& options, const cv::Mat& image, const cv::Mat& spectrum,
+           const cv::Mat& haar)
+{
+  const auto start = std::chrono::steady_clock::now();
+  Row row;
+  cv::Mat result;
+  if (job.filter)
+  {
+    row.mode = "filter";
+    row.variant = image_processing::filterName(job.spec.type);
+    row.parameter = job.spec.D0;
+    cv::Mat filtered;
+    image_processing::filtering(spectrum, filtered, job.spec, image.cols, 1);
+    FFT::irfft2d(filtered, result, image.cols, 1);
+  }
+  else
+  {
+    row.mode = "wavelet";
+    row.variant = shrinkageName(job.shrinkageType);
+    row.parameter = job.threshold;
+    result = haar.clone();
+    const std::vector<cv::Rect> subbands = shrinkage::haarSubbands(result.size(), options.levels);
+    if (job.automatic)
+    {
+      const std::vector<float> thresholds = shrinkage::estimateThresholds(result, subbands, job.estimator, 1);
+      row.variant += std::string("/") + shrinkage::estimatorName(job.estimator);
+      double sum = 0.0;
+      for (float T : thresholds)
+      {
+        sum += T;
+      }
+      row.parameter = static_cast<float>(sum / std::max<std::size_t>(1, thresholds.size()));
+      shrinkage::shrinkSubbands(result, subbands, job.shrinkageType, thresholds, 1);
+    }
+    else
+    {
+      shrinkage::shrinkSubbands(result, subbands, job.shrinkageType, job.threshold, 1);
+    }
+    row.energyCompaction = metrics::energyCompaction(result);
+    wavelets::haarInverse(result, options.levels);
+  }
+  row.mse = metrics::mse(image, result);
+  row.psnr = metrics::psnr(image, result);
+  row.ssim = metrics::ssim(image, result);
+  row.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return row;
+}
+
+// Function to write the rows as CSV
+bool writeCsv(const std::string& path, const std::vector<Row>& rows)
+{
+  std::ofstream file(path);
+  file << "mode,variant,parameter,mse,psnr,ssim,energy_compaction,ms\n";
+  file << std::setprecision(6);
+  for (const Row& row : rows)
+  {
+    file << row.mode << "," << row.variant << "," << row.parameter << "," << row.mse << "," << row.psnr << ","
+         << row.ssim << ",";
+    if (!std::isnan(row.energyCompaction))
+    {
+      file << row.energyCompaction;
+    }
+    file << "," << row.ms << "\n";
+  }
+  return static_cast<bool>(file);
+}
+
+// Function to run the sweep; returns the process exit code
+int run(const Options& options)
+{
+  cv::Mat input = cv::imread(options.input, cv::IMREAD_GRAYSCALE);
+  if (input.empty())
+  {
+    std::cerr << "Error: could not read " << options.input << std::endl;
+    return 1;
+  }
+  cv::Mat image;
+  input.convertTo(image, CV_32F);
+
+  // Shared, read-only inputs of the combinations
+  cv::Mat spectrum;
+  cv::Mat haar = image.clone();
+  if (options.filters)
+  {
+    image_processing::calculateDFT(image, spectrum);
+  }
+  if (options.wavelets)
+  {
+    wavelets::haarForward(haar, options.levels);
+  }
+
+  const std::vector<Job> jobs = listJobs(options);
+  threading::ThreadPool& pool = threading::defaultPool();
+  const int threads = options.threads > 0 ? std::min(options.threads, pool.size()) : pool.size();
+  std::vector<Row> rows(jobs.size());
+  std::atomic<int> next(0);
+  const auto start = std::chrono::steady_clock::now();
+  pool.parallelFor(
+      threads,
+      [&](int, int, int)
+      {
+        for (int i = next++; i < static_cast<int>(jobs.size()); i = next++)
+        {
+          rows[i] = runJob(jobs[i], options, image, spectrum, haar);
+        }
+      },
+      threads);
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (!writeCsv(options.output, rows))
+  {
+    std::cerr << "Error: could not write " << options.output << std::endl;
+    return 1;
+  }
+  std::cout << std::fixed << std::setprecision(2) << jobs.size() << " combinations on " << image.cols << "x"
+            << image.rows << " in " << seconds << " s on " << threads << " threads, written to " << options.output
+            << std::endl;
+  return 0;
+}
+
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program
+            << " --sweep <image> --output <file.csv> [--mode all|filters|wavelets] [--filter <type>]..."
+               " [--d0 from:to:step] [--order N] [--epsilon E] [--thresholds from:to:step]"
+               " [--estimator visu|bayes|sure]... [--levels N] [--threads N]\n";
+}
+
+// Function to parse the command line; false (after printing why) if it is invalid
+bool parseArguments(int argc, char** argv, Options& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      std::cerr << "Error: missing value for " << arg << std::endl;
+      return false;
+    }
+    const std::string value = argv[++i];
+    bool valid = true;
+    if (arg == "--sweep")
+    {
+      options.input = value;
+    }
+    else if (arg == "--output")
+    {
+      options.output = value;
+    }
+    else if (arg == "--mode")
+    {
+      valid = value == "all" || value == "filters" || value == "wavelets";
+      options.filters = value != "wavelets";
+      options.wavelets = value != "filters";
+    }
+    else if (arg == "--filter")
+    {
+      image_processing::FilterType type;
+      valid = image_processing::parseFilterType(value, type);
+      options.types.push_back(type);
+    }
+    else if (arg == "--d0")
+    {
+      valid = parseRange(value, options.d0);
+    }
+    else if (arg == "--order")
+    {
+      options.order = std::atoi(value.c_str());
+    }
+    else if (arg == "--epsilon")
+    {
+      options.epsilon = static_cast<float>(std::atof(value.c_str()));
+    }
+    else if (arg == "--thresholds")
+    {
+      valid = parseRange(value, options.thresholds);
+    }
+    else if (arg == "--estimator")
+    {
+      shrinkage::Estimator estimator;
+      valid = shrinkage::parseEstimator(value, estimator);
+      options.estimators.push_back(estimator);
+    }
+    else if (arg == "--levels")
+    {
+      options.levels = std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--threads")
+    {
+      options.threads = std::atoi(value.c_str());
+    }
+    else
+    {
+      valid = false;
+    }
+    if (!valid)
+    {
+      std::cerr << "Error: invalid option " << arg << " " << value << std::endl;
+      return false;
+    }
+  }
+
+  if (options.input.empty() || options.output.empty())
+  {
+    std::cerr << "Error: --sweep and --output are required" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Entry point of the sweep mode
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!parseArguments(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+  return run(options);
+}
+
+} // namespace sweep
@@ -0,0 +1,219 @@
+/*
+  *thread_pool.hpp
+    Fixed-size pool of worker threads shared by the parallel code paths
+  *parallelFor splits an index range into contiguous chunks, one per
+   thread; the partition only depends on the range and the thread count,
+   so results do not depend on scheduling.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace threading
+{
+
+class ThreadPool
+{
+public:
+  // threads <= 0 uses one thread per hardware core
+  explicit ThreadPool(int threads = 0)
+  {
+    if (threads <= 0)
+    {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // The calling thread always takes part, so it counts as one of them
+    for (int i = 1; i < threads; ++i)
+    {
+      workers_.emplace_back([this] { workerLoop(); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wakeUp_.notify_all();
+    for (std::thread& worker : workers_)
+    {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Number of threads including the caller
+  int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // Queues a task and returns its future
+  template <typename F>
+  auto submit(F&& task) -> std::future<decltype(task())>
+  {
+    using Result = decltype(task());
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> result = packaged->get_future();
+    push([packaged] { (*packaged)(); });
+    return result;
+  }
+
+  // Calls fn(begin, end, chunk) for `chunks` contiguous pieces of [0, count),
+  // chunks = min(count, maxThreads, size()). `chunk` is in [0, chunks) and can
+  // index per-thread scratch. Blocks until every piece is done; while waiting
+  // the caller runs queued tasks itself, so nested calls cannot deadlock.
+  // If pieces throw, the first exception is rethrown after all of them end.
+  void parallelFor(int count, const std::function<void(int begin, int end, int chunk)>& fn, int maxThreads = 0)
+  {
+    int chunks = std::min(count, size());
+    if (maxThreads > 0)
+    {
+      chunks = std::min(chunks, maxThreads);
+    }
+    if (chunks <= 1)
+    {
+      if (count > 0)
+      {
+        fn(0, count, 0);
+      }
+      return;
+    }
+
+    // The first exception of any chunk is kept and rethrown once every chunk
+    // has finished, so no queued chunk outlives fn
+    struct State
+    {
+      std::atomic<int> remaining;
+      std::mutex mutex;
+      std::exception_ptr error;
+    };
+    auto state = std::make_shared<State>();
+    state->remaining = chunks - 1;
+    auto range = [count, chunks](int c, int& begin, int& end)
+    {
+      begin = static_cast<int>(static_cast<long long>(count) * c / chunks);
+      end = static_cast<int>(static_cast<long long>(count) * (c + 1) / chunks);
+    };
+    auto runChunk = [&fn, state, range](int c)
+    {
+      try
+      {
+        int begin, end;
+        range(c, begin, end);
+        fn(begin, end, c);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->error)
+        {
+          state->error = std::current_exception();
+        }
+      }
+    };
+
+    for (int c = 1; c < chunks; ++c)
+    {
+      push(
+          [runChunk, state, c, this]
+          {
+            runChunk(c);
+            if (state->remaining.fetch_sub(1) == 1)
+            {
+              std::lock_guard<std::mutex> lock(mutex_);
+              done_.notify_all();
+            }
+          });
+    }
+
+    runChunk(0);
+
+    while (state->remaining.load() > 0)
+    {
+      if (!runPending())
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return state->remaining.load() == 0 || !tasks_.empty(); });
+      }
+    }
+    if (state->error)
+    {
+      std::rethrow_exception(state->error);
+    }
+  }
+
+private:
+  void push(std::function<void()> task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push(std::move(task));
+    }
+    wakeUp_.notify_one();
+    done_.notify_all();
+  }
+
+  // Runs one queued task on the calling thread, if there is any
+  bool runPending()
+  {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (tasks_.empty())
+      {
+        return false;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+    return true;
+  }
+
+  void workerLoop()
+  {
+    while (true)
+    {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wakeUp_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (stopping_ && tasks_.empty())
+        {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable wakeUp_;
+  std::condition_variable done_;
+  bool stopping_ = false;
+};
+
+// Process-wide pool with one thread per hardware core
+ThreadPool& defaultPool()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+} // namespace threading
@@ -0,0 +1,564 @@
+/*
+  *tiled.hpp
+    Out-of-core frequency-domain filtering of images too large for memory
+  *Usage:
+     IMS --tiled <input.pgm|input.raw> --output <file.pgm> --filter <spec> [--filter <spec> ...]
+         [--raw WxH[:16]] [--tile N] [--radius R] [--normalize 0|1] [--threads N]
+   <spec> is "type:D0[:n[:epsilon]]" as in batch mode; D0 keeps its meaning
+   for the full image, so the result matches batch mode on the same file.
+  *Filtering the whole spectrum is a circular convolution with the spatial
+   kernel of H. The kernel is sampled on one tile (N x N, --tile, 2048 by
+   default), cut to the square of radius R that holds all but 1e-3 of its
+   L1 mass (at most N/4, or --radius) and applied by overlap-save: each
+   tile gives its central (N - 2R)^2 pixels, the input being read with
+   periodic wrap-around like the full DFT sees it. Smooth filters match
+   the full-image result to a fraction of a gray level; the kernels of the
+   hard-edged ones (ideal, band pass, notch) decay too slowly for any tile
+   and only match approximately (a warning says so).
+  *Input is a binary PGM (8 or 16 bit) or headerless raw file (--raw, 16-bit
+   little endian with :16), memory-mapped and read a tile at a time. Output
+   is an 8-bit PGM written one strip of tiles at a time. With --normalize 1
+   (default) the output is scaled to the full 0-255 range like reverseDTF
+   does, which takes a first pass for the minimum and maximum.
+  *Peak memory: one strip (N - 2R rows of the output) plus three N x N
+   float buffers per thread, whatever the image size.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TILED_MMAP 1
+#endif
+
+#include "FFT.hpp"
+#include "image_processing.hpp"
+#include "thread_pool.hpp"
+
+namespace tiled
+{
+
+// Share of the kernel's L1 mass allowed outside the automatic radius
+const double kKernelTailTolerance = 1e-3;
+
+struct Options
+{
+  std::string input;
+  std::string output;
+  std::vector<image_processing::FilterSpec> chain;
+  int rawCols = 0; // Raw input size; 0 = the input is a PGM
+  int rawRows = 0;
+  int rawBits = 8;
+  int tile = 2048;
+  int radius = -1; // -1 = from the kernel
+  bool normalize = true;
+  int threads = 0; // 0 = all cores
+};
+
+// Read-only 8- or 16-bit gray image in a file (PGM or raw), memory-mapped
+// where the platform allows it and read through seeks otherwise
+class ImageFile
+{
+public:
+  ImageFile() = default;
+  ImageFile(const ImageFile&) = delete;
+  ImageFile& operator=(const ImageFile&) = delete;
+
+  ~ImageFile()
+  {
+#if defined(TILED_MMAP)
+    if (mapped_)
+    {
+      munmap(mapped_, mappedBytes_);
+    }
+#endif
+  }
+
+  // Function to open a binary PGM (P5); false if it is not one
+  bool openPgm(const std::string& path)
+  {
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    file >> magic;
+    int maxValue = 0;
+    if (magic != "P5" || !readHeaderValue(file, cols_) || !readHeaderValue(file, rows_) ||
+        !readHeaderValue(file, maxValue) || maxValue <= 0 || maxValue > 65535)
+    {
+      return false;
+    }
+    file.get(); // The single whitespace before the pixels
+    bytesPerPixel_ = maxValue > 255 ? 2 : 1;
+    bigEndian_ = true;
+    maxValue_ = maxValue;
+    return open(path, static_cast<std::size_t>(file.tellg()));
+  }
+
+  // Function to open a headerless raw file of cols x rows pixels (16-bit ones little endian)
+  bool openRaw(const std::string& path, int cols, int rows, int bits)
+  {
+    cols_ = cols;
+    rows_ = rows;
+    bytesPerPixel_ = bits > 8 ? 2 : 1;
+    bigEndian_ = false;
+    maxValue_ = bits > 8 ? 65535 : 255;
+    return open(path, 0);
+  }
+
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+  int maxValue() const { return maxValue_; }
+
+  // Function to read `count` pixels of row y from column x on, as float.
+  // Rows and columns outside the image wrap around (periodic extension).
+  void read(int y, int x, int count, float* out) const
+  {
+    y = wrap(y, rows_);
+    x = wrap(x, cols_);
+    while (count > 0)
+    {
+      const int n = std::min(count, cols_ - x);
+      const std::size_t offset = dataOffset_ + (static_cast<std::size_t>(y) * cols_ + x) * bytesPerPixel_;
+#if defined(TILED_MMAP)
+      convert(static_cast<const unsigned char*>(mapped_) + offset, n, out);
+#else
+      buffer_.resize(static_cast<std::size_t>(n) * bytesPerPixel_);
+      file_.seekg(offset);
+      file_.read(reinterpret_cast<char*>(buffer_.data()), buffer_.size());
+      convert(buffer_.data(), n, out);
+#endif
+      out += n;
+      count -= n;
+      x = 0;
+    }
+  }
+
+private:
+  static int wrap(int i, int n) { return ((i % n) + n) % n; }
+
+  // Function to read one header number, skipping comments
+  static bool readHeaderValue(std::ifstream& file, int& value)
+  {
+    file >> std::ws;
+    while (file.peek() == '#')
+    {
+      file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+      file >> std::ws;
+    }
+    return static_cast<bool>(file >> value);
+  }
+
+  bool open(const std::string& path, std::size_t dataOffset)
+  {
+    dataOffset_ = dataOffset;
+    const std::size_t needed = dataOffset_ + static_cast<std::size_t>(rows_) * cols_ * bytesPerPixel_;
+    if (rows_ <= 0 || cols_ <= 0)
+    {
+      return false;
+    }
+#if defined(TILED_MMAP)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < needed)
+    {
+      if (fd >= 0)
+      {
+        close(fd);
+      }
+      return false;
+    }
+    mappedBytes_ = needed;
+    void* mapped = mmap(nullptr, mappedBytes_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file open
+    if (mapped == MAP_FAILED)
+    {
+      return false;
+    }
+    mapped_ = mapped;
+    return true;
+#else
+    file_.open(path, std::ios::binary);
+    file_.seekg(0, std::ios::end);
+    return file_ && static_cast<std::size_t>(file_.tellg()) >= needed;
+#endif
+  }
+
+  void convert(const unsigned char* bytes, int n, float* out) const
+  {
+    if (bytesPerPixel_ == 1)
+    {
+      for (int i = 0; i < n; i++)
+      {
+        out[i] = bytes[i];
+      }
+      return;
+    }
+    for (int i = 0; i < n; i++)
+    {
+      const unsigned char hi = bytes[2 * i + (bigEndian_ ? 0 : 1)];
+      const unsigned char lo = bytes[2 * i + (bigEndian_ ? 1 : 0)];
+      out[i] = static_cast<float>((hi << 8) | lo);
+    }
+  }
+
+  int rows_ = 0;
+  int cols_ = 0;
+  int bytesPerPixel_ = 1;
+  bool bigEndian_ = false;
+  int maxValue_ = 255;
+  std::size_t dataOffset_ = 0;
+#if defined(TILED_MMAP)
+  void* mapped_ = nullptr;
+  std::size_t mappedBytes_ = 0;
+#else
+  // Seek-and-read fallback; one reader thread at a time
+  mutable std::ifstream file_;
+  mutable std::vector<unsigned char> buffer_;
+#endif
+};
+
+// Transfer function of the truncated kernel on one tile, for a chain of
+// filters specified for a rows x cols image
+class TileKernel
+{
+public:
+  TileKernel(const std::vector<image_processing::FilterSpec>& chain, int rows, int cols, int tile, int radius = -1)
+      : tile_(tile), plan_(tile, tile)
+  {
+    const int halfCols = tile / 2 + 1;
+
+    // H at the frequencies of the tile bins, in full-image bins: bin (u, v)
+    // of the tile is frequency (u / tile, v / tile), i.e. full-image bin
+    // (u * rows / tile, v * cols / tile)
+    const image_processing::ChainGain chainGain(chain, maxRadialDistance(rows, cols));
+    cv::Mat spectrum(tile, halfCols, CV_32FC2);
+    std::vector<float> D(halfCols), gain(halfCols), next(halfCols);
+    for (int u = 0; u < tile; u++)
+    {
+      const float du = std::min(u, tile - u) * static_cast<float>(rows) / tile;
+      for (int v = 0; v < halfCols; v++)
+      {
+        const float dv = v * static_cast<float>(cols) / tile;
+        D[v] = std::sqrt(du * du + dv * dv);
+      }
+      chainGain(D.data(), gain.data(), next.data(), halfCols);
+      cv::Vec2f* row = spectrum.ptr<cv::Vec2f>(u);
+      for (int v = 0; v < halfCols; v++)
+      {
+        row[v] = cv::Vec2f(gain[v], 0.0f);
+      }
+    }
+
+    // Spatial kernel (origin at (0, 0), periodic in the tile), then its radius
+    cv::Mat kernel;
+    plan_.inverse(spectrum, kernel, 0);
+    std::vector<double> ringMass(tile / 2 + 1, 0.0);
+    double totalMass = 0.0;
+    for (int y = 0; y < tile; y++)
+    {
+      const float* k = kernel.ptr<float>(y);
+      for (int x = 0; x < tile; x++)
+      {
+        ringMass[chebyshevRadius(y, x)] += std::abs(k[x]);
+        totalMass += std::abs(k[x]);
+      }
+    }
+    double inside = 0.0;
+    int needed = 0;
+    while (needed < tile / 2 && totalMass - (inside + ringMass[needed]) > kKernelTailTolerance * totalMass)
+    {
+      inside += ringMass[needed++];
+    }
+    radius_ = radius >= 0 ? std::min(radius, tile / 4) : std::min(needed, tile / 4);
+    tailMass_ = 0.0;
+    for (int r = radius_ + 1; r <= tile / 2; r++)
+    {
+      tailMass_ += ringMass[r];
+    }
+    tailMass_ = totalMass > 0.0 ? tailMass_ / totalMass : 0.0;
+
+    // The truncated kernel back to a (real, even) transfer function
+    for (int y = 0; y < tile; y++)
+    {
+      float* k = kernel.ptr<float>(y);
+      for (int x = 0; x < tile; x++)
+      {
+        if (chebyshevRadius(y, x) > radius_)
+        {
+          k[x] = 0.0f;
+        }
+      }
+    }
+    plan_.forward(kernel, spectrum, 0);
+    gain_.create(tile, halfCols, CV_32F);
+    for (int u = 0; u < tile; u++)
+    {
+      const cv::Vec2f* in = spectrum.ptr<cv::Vec2f>(u);
+      float* out = gain_.ptr<float>(u);
+      for (int v = 0; v < halfCols; v++)
+      {
+        out[v] = in[v][0];
+      }
+    }
+  }
+
+  int tile() const { return tile_; }
+  int radius() const { return radius_; }
+  // Output pixels per tile side
+  int block() const { return tile_ - 2 * radius_; }
+  // Share of the kernel's L1 mass cut off by the radius
+  double tailMass() const { return tailMass_; }
+
+  // Function to filter one tile in place (tile x tile, CV_32F). Only the
+  // pixels at least radius() away from the edges are valid.
+  void apply(cv::Mat& tile, cv::Mat& spectrum) const
+  {
+    plan_.forward(tile, spectrum, 1);
+    for (int u = 0; u < tile_; u++)
+    {
+      const float* g = gain_.ptr<float>(u);
+      cv::Vec2f* s = spectrum.ptr<cv::Vec2f>(u);
+      for (int v = 0; v < spectrum.cols; v++)
+      {
+        s[v][0] *= g[v];
+        s[v][1] *= g[v];
+      }
+    }
+    plan_.inverse(spectrum, tile, 1);
+  }
+
+private:
+  int chebyshevRadius(int y, int x) const { return std::max(std::min(y, tile_ - y), std::min(x, tile_ - x)); }
+
+  int tile_;
+  int radius_ = 0;
+  double tailMass_ = 0.0;
+  FFT::RealPlan2d<float> plan_;
+  cv::Mat gain_;
+};
+
+// Function to filter the image strip by strip: fn(y, strip) gets the rows
+// [y, y + strip.rows) of the filtered image (CV_32F) in order
+template <typename F>
+void forEachStrip(const ImageFile& image, const TileKernel& kernel, int threads, F&& fn)
+{
+  const int block = kernel.block();
+  const int tile = kernel.tile();
+  const int radius = kernel.radius();
+  const int tilesPerStrip = (image.cols() + block - 1) / block;
+  threading::ThreadPool& pool = threading::defaultPool();
+  threads = threads > 0 ? std::min(threads, pool.size()) : pool.size();
+
+  cv::Mat strip;
+  for (int y0 = 0; y0 < image.rows(); y0 += block)
+  {
+    strip.create(std::min(block, image.rows() - y0), image.cols(), CV_32F);
+    pool.parallelFor(
+        tilesPerStrip,
+        [&](int begin, int end, int)
+        {
+          cv::Mat data(tile, tile, CV_32F), spectrum;
+          for (int t = begin; t < end; t++)
+          {
+            const int x0 = t * block;
+            for (int y = 0; y < tile; y++)
+            {
+              image.read(y0 - radius + y, x0 - radius, tile, data.ptr<float>(y));
+            }
+            kernel.apply(data, spectrum);
+            const int width = std::min(block, image.cols() - x0);
+            for (int y = 0; y < strip.rows; y++)
+            {
+              const float* in = data.ptr<float>(radius + y) + radius;
+              std::copy(in, in + width, strip.ptr<float>(y) + x0);
+            }
+          }
+        },
+#if defined(TILED_MMAP)
+        threads);
+#else
+        1);
+#endif
+    fn(y0, strip);
+  }
+}
+
+// Function to run the tiled filter; returns the process exit code
+int run(const Options& options)
+{
+  ImageFile image;
+  const bool opened = options.rawCols > 0
+                          ? image.openRaw(options.input, options.rawCols, options.rawRows, options.rawBits)
+                          : image.openPgm(options.input);
+  if (!opened)
+  {
+    std::cerr << "Error: could not read " << options.input << " as " << (options.rawCols > 0 ? "raw" : "PGM")
+              << std::endl;
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  // An even, 2-3-5 smooth tile size
+  const int tile = 2 * FFT::nextSmoothSize((options.tile + 1) / 2);
+  const TileKernel kernel(options.chain, image.rows(), image.cols(), tile, options.radius);
+  std::cout << image.cols() << "x" << image.rows() << ", tile " << kernel.tile() << ", kernel radius "
+            << kernel.radius() << ", " << std::setprecision(3) << kernel.tailMass() * 100.0
+            << "% of the kernel cut off" << std::endl;
+  if (kernel.tailMass() > kKernelTailTolerance)
+  {
+    std::cerr << "Warning: the kernel does not fit the tile; use a larger --tile for a closer result" << std::endl;
+  }
+
+  // Scale to 0-255: min-max (first pass) or the input range
+  float low = 0.0f;
+  float high = static_cast<float>(image.maxValue());
+  if (options.normalize)
+  {
+    low = std::numeric_limits<float>::max();
+    high = std::numeric_limits<float>::lowest();
+    forEachStrip(image, kernel, options.threads,
+                 [&](int, const cv::Mat& strip)
+                 {
+                   double minValue, maxValue;
+                   cv::minMaxLoc(strip, &minValue, &maxValue);
+                   low = std::min(low, static_cast<float>(minValue));
+                   high = std::max(high, static_cast<float>(maxValue));
+                 });
+  }
+  const double scale = high > low ? 255.0 / (high - low) : 0.0;
+
+  std::ofstream output(options.output, std::ios::binary);
+  output << "P5\n" << image.cols() << " " << image.rows() << "\n255\n";
+  cv::Mat bytes;
+  forEachStrip(image, kernel, options.threads,
+               [&](int, const cv::Mat& strip)
+               {
+                 strip.convertTo(bytes, CV_8U, scale, -low * scale);
+                 for (int y = 0; y < bytes.rows; y++)
+                 {
+                   output.write(reinterpret_cast<const char*>(bytes.ptr<uchar>(y)), bytes.cols);
+                 }
+               });
+  if (!output)
+  {
+    std::cerr << "Error: could not write " << options.output << std::endl;
+    return 1;
+  }
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const double mpix = image.rows() * static_cast<double>(image.cols()) / 1e6;
+  std::cout << std::fixed << std::setprecision(2) << "Filtered " << mpix << " MPix in " << seconds << " s ("
+            << mpix * (options.normalize ? 2 : 1) / seconds << " MPix/s per pass), written to " << options.output
+            << std::endl;
+  return 0;
+}
+
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program
+            << " --tiled <input.pgm|input.raw> --output <file.pgm> --filter <type:D0[:n[:epsilon]]> [--filter ...]"
+               " [--raw WxH[:16]] [--tile N] [--radius R] [--normalize 0|1] [--threads N]\n";
+}
+
+// Function to parse the command line; false (after printing why) if it is invalid
+bool parseArguments(int argc, char** argv, Options& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      std::cerr << "Error: missing value for " << arg << std::endl;
+      return false;
+    }
+    const std::string value = argv[++i];
+    bool valid = true;
+    if (arg == "--tiled")
+    {
+      options.input = value;
+    }
+    else if (arg == "--output")
+    {
+      options.output = value;
+    }
+    else if (arg == "--filter")
+    {
+      image_processing::FilterSpec spec;
+      valid = image_processing::parseFilterSpec(value, spec);
+      options.chain.push_back(spec);
+    }
+    else if (arg == "--raw")
+    {
+      char x = 0;
+      options.rawBits = 8;
+      const int fields = std::sscanf(value.c_str(), "%d%c%d:%d", &options.rawCols, &x, &options.rawRows,
+                                     &options.rawBits);
+      valid = fields >= 3 && x == 'x' && options.rawCols > 0 && options.rawRows > 0 &&
+              (options.rawBits == 8 || options.rawBits == 16);
+    }
+    else if (arg == "--tile")
+    {
+      options.tile = std::atoi(value.c_str());
+      valid = options.tile >= 16;
+    }
+    else if (arg == "--radius")
+    {
+      options.radius = std::atoi(value.c_str());
+    }
+    else if (arg == "--normalize")
+    {
+      valid = value == "0" || value == "1";
+      options.normalize = value == "1";
+    }
+    else if (arg == "--threads")
+    {
+      options.threads = std::atoi(value.c_str());
+    }
+    else
+    {
+      valid = false;
+    }
+    if (!valid)
+    {
+      std::cerr << "Error: invalid option " << arg << " " << value << std::endl;
+      return false;
+    }
+  }
+
+  if (options.input.empty() || options.output.empty() || options.chain.empty())
+  {
+    std::cerr << "Error: --tiled, --output and at least one --filter are required" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Entry point of the tiled mode
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!parseArguments(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+  return run(options);
+}
+
+} // namespace tiled
@@ -1,15 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include "opencv2/opencv.hpp"
+#include "profiler.hpp"
+#include "shrinkage.hpp"
+#include "thread_pool.hpp"
 
 namespace wavelets
 {
 
-// Filter type
-#define NONE 0   // no filter
-#define HARD 1   // hard shrinkage
-#define SOFT 2   // soft shrinkage
-#define GARROT 3 // garrot filter
+// Filter type: NONE, HARD, SOFT or GARROT, see shrinkage.hpp
 
 // signum function
 float sgn(float x)
@@ -19,6 +22,7 @@ float sgn(float x)
   return (x > 0) ? 1 : -1;
 }
 
+// Scalar references of the shrinkage kernels in shrinkage.hpp
 // Soft shrinkage
 float soft_shrink(float d, float T)
 {
@@ -38,111 +42,271 @@ float hard_shrink(float d, float T) { return (fabs(d) > T) ? d : 0; }
 // Garrot shrinkage
 float Garrot_shrink(float d, float T) { return (fabs(d) > T) ? d - ((T * T) / d) : 0; }
 
-// Wavelet transform
-static void cvHaarWavelet(cv::Mat& src, cv::Mat& dst, int NIter)
+// Output 2x2 blocks below which a level of cvHaarWavelet/cvInvHaarWavelet runs
+// on the calling thread: deep levels are too small to pay for the hand-off
+const long long kMinParallelBlocks = 128 * 128;
+
+// Function to run fn(begin, end) over `rows` rows of a level in contiguous
+// bands on the thread pool, `cols` values per row. parallelFor returns once
+// every band is done, which is the barrier before the next level.
+// threads: 0 = all cores, 1 = serial
+template <typename Fn>
+void forEachBand(int rows, int cols, int threads, const Fn& fn)
+{
+  const bool small = static_cast<long long>(rows) * cols < kMinParallelBlocks;
+  threading::defaultPool().parallelFor(rows, [&](int begin, int end, int) { fn(begin, end); }, small ? 1 : threads);
+}
+
+// Function to copy rows [begin, end) and the first `cols` columns of `from` into `to`
+inline void copyRows(const cv::Mat& from, cv::Mat& to, int begin, int end, int cols)
+{
+  for (int y = begin; y < end; y++)
+  {
+    std::memcpy(to.ptr<float>(y), from.ptr<float>(y), cols * sizeof(float));
+  }
+}
+
+// Wavelet transform. Every 2x2 block of a level is independent, so each level
+// is split into row bands over the thread pool; the result is the same for
+// any thread count. threads: 0 = all cores, 1 = serial
+static void cvHaarWavelet(cv::Mat& src, cv::Mat& dst, int NIter, int threads = 0)
 {
-  float c, dh, dv, dd;
+  // Each level reads and writes its region, then copies dst back to src
+  PROFILE_SCOPE("cvHaarWavelet", (3 + 2 * NIter) * src.total() * sizeof(float));
   assert(src.type() == CV_32FC1);
   assert(dst.type() == CV_32FC1);
   int width = src.cols;
   int height = src.rows;
   for (int k = 0; k < NIter; k++)
   {
-    for (int y = 0; y < (height >> (k + 1)); y++)
-    {
-      for (int x = 0; x < (width >> (k + 1)); x++)
-      {
-        c = (src.at<float>(2 * y, 2 * x) + src.at<float>(2 * y, 2 * x + 1) + src.at<float>(2 * y + 1, 2 * x) +
-             src.at<float>(2 * y + 1, 2 * x + 1)) *
-            0.5;
-        dst.at<float>(y, x) = c;
-
-        dh = (src.at<float>(2 * y, 2 * x) + src.at<float>(2 * y + 1, 2 * x) - src.at<float>(2 * y, 2 * x + 1) -
-              src.at<float>(2 * y + 1, 2 * x + 1)) *
-             0.5;
-        dst.at<float>(y, x + (width >> (k + 1))) = dh;
-
-        dv = (src.at<float>(2 * y, 2 * x) + src.at<float>(2 * y, 2 * x + 1) - src.at<float>(2 * y + 1, 2 * x) -
-              src.at<float>(2 * y + 1, 2 * x + 1)) *
-             0.5;
-        dst.at<float>(y + (height >> (k + 1)), x) = dv;
-
-        dd = (src.at<float>(2 * y, 2 * x) - src.at<float>(2 * y, 2 * x + 1) - src.at<float>(2 * y + 1, 2 * x) +
-              src.at<float>(2 * y + 1, 2 * x + 1)) *
-             0.5;
-        dst.at<float>(y + (height >> (k + 1)), x + (width >> (k + 1))) = dd;
-      }
-    }
-    dst.copyTo(src);
+    const int halfH = height >> (k + 1);
+    const int halfW = width >> (k + 1);
+    forEachBand(halfH, halfW, threads,
+                [&](int begin, int end)
+                {
+                  for (int y = begin; y < end; y++)
+                  {
+                    const float* s0 = src.ptr<float>(2 * y);
+                    const float* s1 = src.ptr<float>(2 * y + 1);
+                    float* top = dst.ptr<float>(y);
+                    float* bottom = dst.ptr<float>(y + halfH);
+                    for (int x = 0; x < halfW; x++)
+                    {
+                      top[x] = (s0[2 * x] + s0[2 * x + 1] + s1[2 * x] + s1[2 * x + 1]) * 0.5;
+                      top[x + halfW] = (s0[2 * x] + s1[2 * x] - s0[2 * x + 1] - s1[2 * x + 1]) * 0.5;
+                      bottom[x] = (s0[2 * x] + s0[2 * x + 1] - s1[2 * x] - s1[2 * x + 1]) * 0.5;
+                      bottom[x + halfW] = (s0[2 * x] - s0[2 * x + 1] - s1[2 * x] + s1[2 * x + 1]) * 0.5;
+                    }
+                  }
+                });
+    forEachBand(height, width, threads, [&](int begin, int end) { copyRows(dst, src, begin, end, width); });
   }
 }
 
-// Inverse wavelet transform
-static void cvInvHaarWavelet(cv::Mat& src, cv::Mat& dst, int NIter, int SHRINKAGE_TYPE = 0, float SHRINKAGE_T = 50)
+// Inverse wavelet transform, split into row bands like cvHaarWavelet.
+// threads: 0 = all cores, 1 = serial
+static void cvInvHaarWavelet(cv::Mat& src, cv::Mat& dst, int NIter, int SHRINKAGE_TYPE = 0, float SHRINKAGE_T = 50,
+                             int threads = 0)
 {
-  float c, dh, dv, dd;
+  PROFILE_SCOPE("cvInvHaarWavelet", 6 * src.total() * sizeof(float));
   assert(src.type() == CV_32FC1);
   assert(dst.type() == CV_32FC1);
   int width = src.cols;
   int height = src.rows;
+
+  // Shrinkage, as a separate pass over the detail subbands of every level
+  shrinkage::shrinkSubbands(src, shrinkage::haarSubbands(src.size(), NIter), SHRINKAGE_TYPE, SHRINKAGE_T, threads);
+
   for (int k = NIter; k > 0; k--)
   {
-    for (int y = 0; y < (height >> k); y++)
+    const int halfH = height >> k;
+    const int halfW = width >> k;
+    forEachBand(halfH, halfW, threads,
+                [&](int begin, int end)
+                {
+                  for (int y = begin; y < end; y++)
+                  {
+                    const float* top = src.ptr<float>(y);
+                    const float* bottom = src.ptr<float>(y + halfH);
+                    float* d0 = dst.ptr<float>(2 * y);
+                    float* d1 = dst.ptr<float>(2 * y + 1);
+                    for (int x = 0; x < halfW; x++)
+                    {
+                      const float c = top[x];
+                      const float dh = top[x + halfW];
+                      const float dv = bottom[x];
+                      const float dd = bottom[x + halfW];
+                      d0[2 * x] = 0.5 * (c + dh + dv + dd);
+                      d0[2 * x + 1] = 0.5 * (c - dh + dv - dd);
+                      d1[2 * x] = 0.5 * (c + dh - dv - dd);
+                      d1[2 * x + 1] = 0.5 * (c - dh - dv + dd);
+                    }
+                  }
+                });
+    const int regionH = height >> (k - 1);
+    const int regionW = width >> (k - 1);
+    forEachBand(regionH, regionW, threads, [&](int begin, int end) { copyRows(dst, src, begin, end, regionW); });
+  }
+}
+
+// Haar lifting steps on the 2x2 block (a b / c d) -> (ll, dh, dv, dd), with the
+// same scaling as cvHaarWavelet: ll = (a + b + c + d) / 2, dh = (a - b + c - d) / 2,
+// dv = (a + b - c - d) / 2, dd = (a - b - c + d) / 2
+inline void haarLiftForward(float a, float b, float c, float d, float& ll, float& dh, float& dv, float& dd)
+{
+  // Horizontal: predict (difference) then update (mean) on both rows
+  const float dTop = a - b;
+  const float dBottom = c - d;
+  const float sTop = b + 0.5f * dTop;
+  const float sBottom = d + 0.5f * dBottom;
+  // Vertical on the means and on the differences
+  dv = sTop - sBottom;
+  ll = 2.0f * (sBottom + 0.5f * dv);
+  const float dd2 = dTop - dBottom;
+  dh = dBottom + 0.5f * dd2;
+  dd = 0.5f * dd2;
+}
+
+// Exact reverse of haarLiftForward
+inline void haarLiftInverse(float ll, float dh, float dv, float dd, float& a, float& b, float& c, float& d)
+{
+  const float dd2 = 2.0f * dd;
+  const float dBottom = dh - 0.5f * dd2;
+  const float dTop = dd2 + dBottom;
+  const float sBottom = 0.5f * ll - 0.5f * dv;
+  const float sTop = dv + sBottom;
+  b = sTop - 0.5f * dTop;
+  a = dTop + b;
+  d = sBottom - 0.5f * dBottom;
+  c = dBottom + d;
+}
+
+// Moves rows 0..2*half-1 of the region so that even rows go to the top half
+// and odd rows to the bottom half (unshuffle = true), or back. Cycle following
+// with one row buffer: every row is copied once.
+inline void permuteRows(cv::Mat& image, int half, int width, bool unshuffle, std::vector<float>& buffer,
+                        std::vector<char>& visited)
+{
+  const int rows = 2 * half;
+  auto target = [half, unshuffle](int i)
+  {
+    if (unshuffle)
     {
-      for (int x = 0; x < (width >> k); x++)
+      return i % 2 ? half + i / 2 : i / 2;
+    }
+    return i < half ? 2 * i : 2 * (i - half) + 1;
+  };
+  visited.assign(rows, 0);
+  const std::size_t bytes = width * sizeof(float);
+  for (int start = 0; start < rows; start++)
+  {
+    if (visited[start] || target(start) == start)
+    {
+      continue;
+    }
+    // Carry the displaced row around the cycle until it closes
+    std::memcpy(buffer.data(), image.ptr<float>(start), bytes);
+    int i = start;
+    do
+    {
+      const int next = target(i);
+      visited[i] = 1;
+      std::swap_ranges(buffer.data(), buffer.data() + width, image.ptr<float>(next));
+      i = next;
+    } while (i != start);
+  }
+}
+
+// In-place multi-level Haar transform (lifting scheme) of a CV_32FC1 image.
+// Same coefficients and layout as cvHaarWavelet, but each level only touches
+// its active top-left region and no full-size temporary is allocated. With
+// odd region sizes the last row/column is left as it is, so haarInverse
+// restores the image exactly.
+void haarForward(cv::Mat& image, int levels)
+{
+  CV_Assert(image.type() == CV_32FC1);
+  // Lifting and row permutation each read and write the shrinking active region
+  PROFILE_SCOPE("haarForward", 6 * image.total() * sizeof(float));
+  std::vector<float> top(image.cols), bottom(image.cols), buffer(image.cols);
+  std::vector<char> visited;
+  for (int k = 0; k < levels; k++)
+  {
+    const int halfH = image.rows >> (k + 1);
+    const int halfW = image.cols >> (k + 1);
+    if (halfH == 0 || halfW == 0)
+    {
+      break;
+    }
+
+    // Each row pair becomes [ll | dh] over [dv | dd]
+    for (int y = 0; y < halfH; y++)
+    {
+      float* r0 = image.ptr<float>(2 * y);
+      float* r1 = image.ptr<float>(2 * y + 1);
+      for (int x = 0; x < halfW; x++)
       {
-        c = src.at<float>(y, x);
-        dh = src.at<float>(y, x + (width >> k));
-        dv = src.at<float>(y + (height >> k), x);
-        dd = src.at<float>(y + (height >> k), x + (width >> k));
-
-        // Shrinkage
-        switch (SHRINKAGE_TYPE)
-        {
-          case HARD:
-            dh = hard_shrink(dh, SHRINKAGE_T);
-            dv = hard_shrink(dv, SHRINKAGE_T);
-            dd = hard_shrink(dd, SHRINKAGE_T);
-            break;
-          case SOFT:
-            dh = soft_shrink(dh, SHRINKAGE_T);
-            dv = soft_shrink(dv, SHRINKAGE_T);
-            dd = soft_shrink(dd, SHRINKAGE_T);
-            break;
-          case GARROT:
-            dh = Garrot_shrink(dh, SHRINKAGE_T);
-            dv = Garrot_shrink(dv, SHRINKAGE_T);
-            dd = Garrot_shrink(dd, SHRINKAGE_T);
-            break;
-        }
-
-        dst.at<float>(y * 2, x * 2) = 0.5 * (c + dh + dv + dd);
-        dst.at<float>(y * 2, x * 2 + 1) = 0.5 * (c - dh + dv - dd);
-        dst.at<float>(y * 2 + 1, x * 2) = 0.5 * (c + dh - dv - dd);
-        dst.at<float>(y * 2 + 1, x * 2 + 1) = 0.5 * (c - dh - dv + dd);
+        haarLiftForward(r0[2 * x], r0[2 * x + 1], r1[2 * x], r1[2 * x + 1], top[x], top[halfW + x], bottom[x],
+                        bottom[halfW + x]);
       }
+      std::copy(top.begin(), top.begin() + 2 * halfW, r0);
+      std::copy(bottom.begin(), bottom.begin() + 2 * halfW, r1);
+    }
+    // ... and the [dv | dd] rows move below the [ll | dh] rows
+    permuteRows(image, halfH, 2 * halfW, true, buffer, visited);
+  }
+}
+
+// In-place inverse of haarForward. Shrinkage (NONE, HARD, SOFT or GARROT with
+// threshold T) is applied to the detail coefficients first, as in cvInvHaarWavelet.
+void haarInverse(cv::Mat& coefficients, int levels, int shrinkageType = NONE, float T = 50)
+{
+  CV_Assert(coefficients.type() == CV_32FC1);
+  PROFILE_SCOPE("haarInverse", 6 * coefficients.total() * sizeof(float));
+  cv::Mat& image = coefficients;
+  shrinkage::shrinkSubbands(image, shrinkage::haarSubbands(image.size(), levels), shrinkageType, T);
+  std::vector<float> top(image.cols), bottom(image.cols), buffer(image.cols);
+  std::vector<char> visited;
+
+  for (int k = levels - 1; k >= 0; k--)
+  {
+    const int halfH = image.rows >> (k + 1);
+    const int halfW = image.cols >> (k + 1);
+    if (halfH == 0 || halfW == 0)
+    {
+      continue;
+    }
+
+    permuteRows(image, halfH, 2 * halfW, false, buffer, visited);
+    for (int y = 0; y < halfH; y++)
+    {
+      float* r0 = image.ptr<float>(2 * y);
+      float* r1 = image.ptr<float>(2 * y + 1);
+      for (int x = 0; x < halfW; x++)
+      {
+        haarLiftInverse(r0[x], r0[halfW + x], r1[x], r1[halfW + x], top[2 * x], top[2 * x + 1], bottom[2 * x],
+                        bottom[2 * x + 1]);
+      }
+      std::copy(top.begin(), top.begin() + 2 * halfW, r0);
+      std::copy(bottom.begin(), bottom.begin() + 2 * halfW, r1);
     }
-    cv::Mat C = src(cv::Rect(0, 0, width >> (k - 1), height >> (k - 1)));
-    cv::Mat D = dst(cv::Rect(0, 0, width >> (k - 1), height >> (k - 1)));
-    D.copyTo(C);
   }
 }
 
 void processWavelet(const cv::Mat& img, const int numIter = 3, const int scaleFactor = 1)
 {
-  cv::Mat Src, Dst, Temp, Filtered;
+  cv::Mat Dst, Filtered;
   // Converting from 8-bit to float type suitable for DFT and Wavelets operations
-  img.convertTo(Src, CV_32F);
-
-  Dst = cv::Mat(Src.size(), CV_32FC1);
-  Temp = cv::Mat(Src.size(), CV_32FC1);
-  Filtered = cv::Mat(Src.size(), CV_32FC1);
+  img.convertTo(Dst, CV_32F);
 
-  cvHaarWavelet(Src, Dst, numIter);
+  // Both transforms work in place
+  haarForward(Dst, numIter);
 
-  Dst.copyTo(Temp);
+  Dst.copyTo(Filtered);
 
-  cvInvHaarWavelet(Temp, Filtered, numIter, GARROT, 30);
+  // Garrot shrinkage with a BayesShrink threshold per subband
+  const std::vector<cv::Rect> subbands = shrinkage::haarSubbands(Filtered.size(), numIter);
+  shrinkage::denoise(Filtered, subbands, GARROT, shrinkage::Estimator::Bayes);
+  haarInverse(Filtered, numIter);
 
   double M = 0, m = 0;
 